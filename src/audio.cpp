@@ -0,0 +1,201 @@
+#include <Arduino.h>
+#include "defs.h"
+#include "routine.h"
+#include "scene.h"
+#include "audio.h"
+
+extern Scene scene;
+
+
+// IntervalTimer takes no argument either; there's only the one ADC source
+static AdcAudioSource *adcSource;
+static IntervalTimer adcTimer;
+
+static void onAdcSample() {
+   adcSource->sample();
+}
+
+
+void AdcAudioSource::begin(int pin) {
+   this->pin = pin;
+   sampleRate = rate;
+   head = tail = 0;
+   dropped = 0;
+
+   // one conversion per sample, no averaging: a few us, from an interrupt
+   // that runs below the buttons and the LED DMA
+   analogReadResolution(10);
+   analogReadAveraging(1);
+   adcSource = this;
+   adcTimer.priority(192);
+   adcTimer.begin(onAdcSample, 1000000 / rate);
+}
+
+
+void AdcAudioSource::sample() {
+   uint16_t next = (head + 1) & (size - 1);
+   if (next == tail) {
+      dropped++;
+      return;
+   }
+
+   ring[head] = analogRead(pin);
+   // the sample has to be written before the consumer can see it
+   __sync_synchronize();
+   head = next;
+}
+
+
+int AdcAudioSource::read(uint16_t *samples, int count) {
+   uint16_t from = tail;
+   int n = min(count, (head - from) & (size - 1));
+
+   __sync_synchronize();
+   for (int i = 0; i < n; i++) {
+      samples[i] = ring[(from + i) & (size - 1)];
+   }
+   __sync_synchronize();
+   tail = (from + n) & (size - 1);
+   return n;
+}
+
+
+uint32_t AdcAudioSource::latency() {
+   // the ones still waiting came in after
+   return ((head - tail) & (size - 1)) * (1000000 / rate);
+}
+
+
+int logEnergy(uint32_t x) {
+   if (!x) return 0;
+   int log2 = 31 - __builtin_clz(x);
+   int frac = log2 >= 5 ? x >> (log2 - 5) : x << (5 - log2);
+   return log2 * 32 + (frac & 31);
+}
+
+
+void AudioInput::begin(AudioSource *source) {
+   memset(this, 0, sizeof *this);
+   this->source = source;
+   if (source) {
+      hopMicros = hopSamples * 1000000 / source->sampleRate;
+   }
+   dc = 512 << 8;
+}
+
+
+bool AudioInput::process() {
+   if (!source) {
+      return false;
+   }
+
+   bool hopped = false;
+   uint16_t buf[hopSamples];
+   while (true) {
+      int n = source->read(buf, hopSamples - samples);
+      for (int i = 0; i < n; i++) {
+         // a slow average takes out the DC (and anything under ~10 Hz)
+         int32_t x = buf[i] - (dc >> 8);
+         dc += ((buf[i] << 8) - dc) >> 7;
+         energy += x * x;
+         recent[samplesIn++ & (recentSize - 1)] = x << 4;
+      }
+      samples += n;
+      if (samples < hopSamples) {
+         return hopped;
+      }
+
+      analyzeHop(micros() - source->latency());
+      samples = 0;
+      energy = 0;
+      hopped = true;
+   }
+}
+
+
+void AudioInput::getRecent(int16_t *out, int count) {
+   uint32_t from = samplesIn - count;
+   for (int i = 0; i < count; i++) {
+      out[i] = recent[(from + i) & (recentSize - 1)];
+   }
+}
+
+
+void AudioInput::analyzeHop(uint32_t hopEnd) {
+   int hopLevel = logEnergy(energy);
+   int rise = constrain(hopLevel - lastLevel, 0, 255);
+   lastLevel = hopLevel;
+   level += (hopLevel - level) >> 4;
+   meanFlux += ((rise << 8) - (int32_t)meanFlux) >> 5;
+
+   hops++;
+   flux[hops & (historySize - 1)] = rise;
+
+   // running autocorrelation of the rises: the beat is the lag where they
+   // line up best
+   for (int lag = minLag; lag <= maxLag; lag++) {
+      uint32_t *a = acf + lag - minLag;
+      *a -= *a >> acfDecayShift;
+      *a += rise * flux[(hops - lag) & (historySize - 1)];
+   }
+
+   // An onset is a peak in the rises well above their usual run; it's the
+   // previous hop's, now that this one shows it was the peak.
+   int peak = flux[(hops - 1) & (historySize - 1)];
+   int before = flux[(hops - 2) & (historySize - 1)];
+   int threshold = minOnsetFlux + (meanFlux * 3 >> 9); // 1.5x the mean
+   if (level >= minLevel && peak > threshold && peak >= before && peak > rise &&
+       hops - 1 - lastOnsetHop >= minOnsetGap) {
+      lastOnsetHop = hops - 1;
+      // the middle of that hop
+      scene.onOnset(hopEnd - hopMicros * 3 / 2, peak);
+   }
+
+   if (hops % tempoInterval == 0) {
+      estimateTempo();
+   }
+}
+
+
+void AudioInput::estimateTempo() {
+   static const int numLags = ARRAYSIZE(acf);
+
+   uint32_t total = 0;
+   uint32_t bestScore = 0;
+   int best = 0;
+   for (int i = 0; i < numLags; i++) {
+      total += acf[i];
+      uint32_t score = (acf[i] >> 6) * (64 - abs(i + minLag - preferredLag));
+      if (score > bestScore) {
+         bestScore = score;
+         best = i;
+      }
+   }
+
+   uint32_t mean = total / numLags;
+   confidence = mean ? (uint64_t)acf[best] * 256 / mean : 0;
+   bool sure = level >= minLevel && confidence >= minConfidence;
+   if (!sure) {
+      if (tempo) {
+         DebugPrint("Audio tempo lost\n");
+      }
+      tempo = 0;
+      return;
+   }
+
+   // between hops: fit a parabola through the peak and its neighbours
+   int32_t lag = (best + minLag) * 256;
+   if (best > 0 && best < numLags - 1) {
+      int64_t a = acf[best - 1], b = acf[best], c = acf[best + 1];
+      int64_t curve = a - 2 * b + c;
+      if (curve < 0) {
+         lag += 128 * (a - c) / curve;
+      }
+   }
+
+   if (!tempo) {
+      DebugPrint("Audio tempo %lu us (confidence %d/256)\n",
+                 (uint32_t)lag * hopMicros / 256, confidence);
+   }
+   tempo = (uint32_t)lag * hopMicros / 256;
+}
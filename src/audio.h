@@ -0,0 +1,125 @@
+/*
+ * audio.h
+ *
+ * Beat detection from a microphone, so the beat clock can follow the music
+ * without anyone tapping. Samples come from an AudioSource (the ADC, read
+ * from a timer interrupt); AudioInput::process works through them from the
+ * scene's idle time, a hop (16 ms) at a time:
+ *
+ * - the energy of each hop, on a log scale (so it doesn't matter how loud
+ *   the music is or how the mic is set up);
+ * - onsets: where that jumps by more than it usually does;
+ * - tempo: the running autocorrelation of the jumps, over the lags from 67
+ *   to 187 bpm; the strongest lag (nudged toward 120 bpm, to settle
+ *   half/double ambiguity the way people usually would) is the beat.
+ *
+ * Onsets and the tempo go to Scene::onOnset, which hands them to the beat
+ * tracker; taps win over the audio for a while after each one. Integer
+ * math throughout, a few us per hop. The latest samples are kept, for
+ * routines that want to look at the sound themselves (SpectrumRoutine).
+ */
+
+#pragma once
+
+#include <stdint.h>
+
+
+/*
+ * Where samples come from. Anything that can supply them at sampleRate
+ * will do (the ADC here; a file, to try the detector out on recordings).
+ */
+class AudioSource {
+public:
+   // Up to count samples, oldest first, unsigned 10 bits (the detector
+   // takes out the DC); returns how many there were.
+   virtual int read(uint16_t *samples, int count) = 0;
+   // How long ago the last sample read was taken, in us.
+   virtual uint32_t latency() = 0;
+
+   uint32_t sampleRate;
+};
+
+
+/*
+ * Samples an analog pin from a timer interrupt into a ring, single
+ * producer single consumer like InputEventQueue.
+ */
+class AdcAudioSource : public AudioSource {
+public:
+   static const uint32_t rate = 8000; // Hz; enough to hear kicks and snares by
+   static const int size = 512;       // power of 2; 64 ms of slack for long frames
+
+   void begin(int pin);
+   virtual int read(uint16_t *samples, int count);
+   virtual uint32_t latency();
+
+   void sample(); // from the interrupt handler
+
+   int pin;
+   uint16_t ring[size];
+   volatile uint16_t head; // next to write
+   volatile uint16_t tail; // next to read
+   volatile uint32_t dropped;
+};
+
+
+class AudioInput {
+public:
+   static const int hopSamples = 128;        // per hop, at 8 kHz: 16 ms
+   static const int minLag = 20;             // hops: 320 ms, 187 bpm
+   static const int maxLag = 56;             // 896 ms, 67 bpm
+   static const int preferredLag = 31;       // 500 ms, 120 bpm
+   static const int historySize = 64;        // power of 2, > maxLag
+   static const int acfDecayShift = 8;       // autocorrelation forgets over ~4 s
+   static const int tempoInterval = 16;      // hops between tempo estimates
+   static const int minOnsetGap = 6;         // hops; faster onsets are one onset
+   static const int minOnsetFlux = 24;       // 1/32 octaves of energy, ~2 dB
+   static const int minLevel = 12 * 32;      // quieter than this is no music
+   static const int minConfidence = 320;     // peak/mean autocorrelation, x256
+   static const int recentSize = 128;        // power of 2; samples kept
+
+   // source may be NULL, for no audio input
+   void begin(AudioSource *source);
+   // Work through the samples that have come in; returns false if there
+   // weren't enough for a hop.
+   bool process();
+   // The latest count (up to recentSize) samples, oldest first, DC taken
+   // out and scaled to 14 bits and sign.
+   void getRecent(int16_t *out, int count);
+
+   AudioSource *source;
+   uint32_t hopMicros;
+
+   // per hop
+   int32_t dc;        // the ADC's midpoint, 10.8 fixed point
+   uint32_t energy;   // sum of squares so far this hop
+   int samples;       // so far this hop
+   int lastLevel;     // log energy of the previous hop
+   int level;         // and smoothed, 1/32 octaves of energy
+   uint32_t meanFlux; // 8.8 fixed point
+
+   // onsets
+   uint8_t flux[historySize]; // rises in level, latest at hops
+   uint32_t hops;
+   uint32_t lastOnsetHop;
+
+   // the samples themselves
+   int16_t recent[recentSize];
+   uint32_t samplesIn; // ever; the latest is at samplesIn - 1
+
+   // tempo
+   uint32_t acf[maxLag - minLag + 1];
+   uint32_t tempo;     // us per beat; 0 while unsure
+   int confidence;     // x256
+
+private:
+   void analyzeHop(uint32_t hopEnd);
+   void estimateTempo();
+};
+
+
+// log2(x), in 1/32 octaves (of energy, 3 dB each)
+int logEnergy(uint32_t x);
+
+
+extern AudioInput audio;
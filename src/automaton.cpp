@@ -0,0 +1,276 @@
+#include <Arduino.h>
+#include "defs.h"
+#include "routine.h"
+#include "framebuffer.h"
+#include "automaton.h"
+#include "platform.h"
+
+extern Framebuffer fb;
+
+
+// Bit-sliced sum of eight words of single bits: c[0] the ones of every
+// cell's count, c[1] the twos, c[2] the fours and c[3] the eights.
+static inline void countBits(const uint32_t n[8], uint32_t c[4]) {
+   // three full adders (well, two and a half) down to sums and carries
+   uint32_t s1 = n[0] ^ n[1] ^ n[2], k1 = (n[0] & n[1]) | (n[2] & (n[0] ^ n[1]));
+   uint32_t s2 = n[3] ^ n[4] ^ n[5], k2 = (n[3] & n[4]) | (n[5] & (n[3] ^ n[4]));
+   uint32_t s3 = n[6] ^ n[7], k3 = n[6] & n[7];
+   // then the sums, and the carries a bit up
+   c[0] = s1 ^ s2 ^ s3;
+   uint32_t ka = (s1 & s2) | (s3 & (s1 ^ s2));
+   uint32_t t1 = k1 ^ k2 ^ k3, d1 = (k1 & k2) | (k3 & (k1 ^ k2));
+   c[1] = t1 ^ ka;
+   uint32_t d2 = t1 & ka;
+   c[2] = d1 ^ d2;
+   c[3] = d1 & d2;
+}
+
+// the cells whose count is exactly n
+static inline uint32_t countIs(const uint32_t c[4], int n) {
+   uint32_t match = ~0;
+   for (int b = 0; b < 4; b++) {
+      match &= (n >> b) & 1 ? c[b] : ~c[b];
+   }
+   return match;
+}
+
+// and at least n
+static inline uint32_t countAtLeast(const uint32_t c[4], int n) {
+   uint32_t above = 0, match = ~0;
+   for (int b = 3; b >= 0; b--) {
+      if ((n >> b) & 1) {
+         match &= c[b];
+      } else {
+         above |= match & c[b];
+         match &= ~c[b];
+      }
+   }
+   return above | match;
+}
+
+
+void CellularAutomaton::begin(uint32_t *storage, int width, int height, Rule rule) {
+   this->rule = rule;
+   this->width = width;
+   this->height = height;
+   stride = wordsPerRow(width);
+   lastMask = width % 32 ? (1u << (width % 32)) - 1 : ~0u;
+   latest = storage;
+   previous = storage + planesPerGeneration * height * stride;
+   generation = 0;
+   memset(storage, 0, storageWords(width, height) * sizeof *storage);
+}
+
+
+void CellularAutomaton::seed(int density) {
+   // into the latest only, so whatever was there fades into it
+   memset(latest, 0, planesPerGeneration * height * stride * sizeof *latest);
+   uint32_t *s0 = plane(latest, 0), *s1 = plane(latest, 1);
+   for (int y = 0; y < height; y++) {
+      for (int x = 0; x < width; x++) {
+         if (random(256) >= density) continue;
+         int state = rule == RULE_CYCLIC ? random(cyclicStates) : 1;
+         uint32_t bit = 1u << (x & 31);
+         int i = y * stride + x / 32;
+         if (state & 1) s0[i] |= bit;
+         if (state & 2) s1[i] |= bit;
+      }
+   }
+}
+
+
+void CellularAutomaton::rowsAround(uint32_t *plane, int y, uint32_t *rows[3]) {
+   rows[0] = plane + (y ? y - 1 : height - 1) * stride;
+   rows[1] = plane + y * stride;
+   rows[2] = plane + (y < height - 1 ? y + 1 : 0) * stride;
+}
+
+inline void CellularAutomaton::neighbours(uint32_t *rows[3], int j, uint32_t n[8]) {
+   int last = stride - 1;
+   int top = (width - 1) & 31; // the last cell's bit in the last word
+
+   // west: what's at x - 1, moved to x; east: x + 1
+   uint32_t west[3], east[3];
+   for (int r = 0; r < 3; r++) {
+      uint32_t *row = rows[r];
+      west[r] = row[j] << 1;
+      west[r] |= j > 0 ? row[j - 1] >> 31 : (row[last] >> top) & 1;
+      east[r] = row[j] >> 1;
+      east[r] |= j < last ? row[j + 1] << 31 : (row[0] & 1) << top;
+      if (j == last) {
+         west[r] &= lastMask;
+      }
+   }
+
+   n[0] = west[0]; n[1] = rows[0][j]; n[2] = east[0];
+   n[3] = west[1];                    n[4] = east[1];
+   n[5] = west[2]; n[6] = rows[2][j]; n[7] = east[2];
+}
+
+
+int CellularAutomaton::step() {
+   uint32_t *next = previous;
+   int changed = 0;
+
+   for (int y = 0; y < height; y++) {
+      uint32_t *rows0[3], *rows1[3];
+      rowsAround(plane(latest, 0), y, rows0);
+      rowsAround(plane(latest, 1), y, rows1);
+
+      for (int j = 0; j < stride; j++) {
+         int i = y * stride + j;
+         uint32_t s0 = plane(latest, 0)[i], s1 = plane(latest, 1)[i];
+         uint32_t n0[8], n1[8], c[4];
+         uint32_t t0, t1; // the next state
+
+         switch (rule) {
+            case RULE_LIFE:
+               neighbours(rows0, j, n0);
+               countBits(n0, c);
+               t0 = countIs(c, 3) | (s0 & countIs(c, 2));
+               t1 = 0;
+               break;
+
+            case RULE_BRAIN:
+               // off with two neighbours on comes on; on starts dying; dying goes off
+               neighbours(rows0, j, n0);
+               countBits(n0, c);
+               t0 = ~s0 & ~s1 & countIs(c, 2);
+               t1 = s0;
+               break;
+
+            case RULE_CYCLIC:
+            default: {
+               neighbours(rows0, j, n0);
+               neighbours(rows1, j, n1);
+               uint32_t advance = 0;
+               for (int k = 0; k < cyclicStates; k++) {
+                  // the cells in state k with enough neighbours in k + 1
+                  int ahead = (k + 1) % cyclicStates;
+                  uint32_t n[8];
+                  for (int m = 0; m < 8; m++) {
+                     n[m] = (ahead & 1 ? n0[m] : ~n0[m]) & (ahead & 2 ? n1[m] : ~n1[m]);
+                  }
+                  countBits(n, c);
+                  uint32_t here = (k & 1 ? s0 : ~s0) & (k & 2 ? s1 : ~s1);
+                  advance |= here & countAtLeast(c, cyclicThreshold);
+               }
+               t0 = s0 ^ advance;
+               t1 = s1 ^ (advance & s0);
+               break;
+            }
+         }
+
+         if (j == stride - 1) {
+            t0 &= lastMask;
+            t1 &= lastMask;
+         }
+
+         // a cell that's stayed non-empty gets older, up to maxAge
+         uint32_t a0 = plane(latest, 2)[i], a1 = plane(latest, 3)[i];
+         uint32_t stayed = (t0 | t1) & (s0 | s1);
+         plane(next, 2)[i] = stayed & (~a0 | a1);
+         plane(next, 3)[i] = stayed & (a1 | a0);
+         plane(next, 0)[i] = t0;
+         plane(next, 1)[i] = t1;
+
+         changed += __builtin_popcount((t0 ^ s0) | (t1 ^ s1));
+      }
+   }
+
+   previous = latest;
+   latest = next;
+   generation++;
+   return changed;
+}
+
+
+int CellularAutomaton::state(int x, int y, bool previous) {
+   uint32_t *g = previous ? this->previous : latest;
+   return bit(g, 0, x, y) | bit(g, 1, x, y) << 1;
+}
+
+int CellularAutomaton::age(int x, int y, bool previous) {
+   uint32_t *g = previous ? this->previous : latest;
+   return bit(g, 2, x, y) | bit(g, 3, x, y) << 1;
+}
+
+
+
+// by age, for Life and Brian's Brain; by state, for cyclic
+static const int automatonPalettes[CellularAutomaton::NUM_RULES][4] = {
+   { 0xFFFFC0, 0x40C0FF, 0x2060C0, 0x102080 }, // born hot, cooling
+   { 0xC0C0FF, 0x4000C0, 0x4000C0, 0x4000C0 }, // on, dying
+   { 0x800000, 0x806000, 0x008040, 0x200080 }, // around the cycle
+};
+
+// how many cells of 256 to start with
+static const int automatonDensities[CellularAutomaton::NUM_RULES] = { 80, 40, 256 };
+
+// the whole canvas; more than the state buffer has room for on a big one
+static uint32_t automatonCells[CellularAutomaton::storageWords(FB_VIRTUAL_WIDTH, FB_VIRTUAL_HEIGHT)];
+
+
+void AutomatonRoutine::begin(void *stateBuf) {
+   static_assert(sizeof(Data) < ROUTINE_STATEBUF_SIZE, "buffer overflow");
+   data = (Data *) stateBuf;
+   memset(data, 0, sizeof *data);
+
+   start();
+}
+
+void AutomatonRoutine::adjustParam(int step) {
+   int rule = (data->ca.rule + step + CellularAutomaton::NUM_RULES) % CellularAutomaton::NUM_RULES;
+   data->ca.rule = (CellularAutomaton::Rule) rule;
+   start();
+}
+
+void AutomatonRoutine::start() {
+   data->ca.begin(automatonCells, fb.width, fb.height, data->ca.rule);
+   data->ca.seed(automatonDensities[data->ca.rule]);
+   data->quietGenerations = 0;
+   fb.clearScreen();
+}
+
+
+void AutomatonRoutine::drawOnBeatSync(FrameTimingInfo *frameTiming) {
+   int changed = data->ca.step();
+
+   // Life settles into still lifes and blinkers, and the rest can die out;
+   // once it's been quiet a while, throw in a fresh lot
+   int cells = data->ca.width * data->ca.height;
+   if (changed * 16 < cells) {
+      data->quietGenerations++;
+   } else {
+      data->quietGenerations = 0;
+   }
+   if (data->quietGenerations >= maxQuietGenerations) {
+      data->ca.seed(automatonDensities[data->ca.rule]);
+      data->quietGenerations = 0;
+   }
+}
+
+void AutomatonRoutine::drawOnFrameSync(FrameTimingInfo *frameTiming) {
+   // from the previous generation to the latest, over the beat
+   int alpha = constrain(frameTiming->beatRelative * 256 / max(frameTiming->beatLength, 1), 0, 256);
+   for (int y = 0; y < data->ca.height; y++) {
+      for (int x = 0; x < data->ca.width; x++) {
+         int from = cellColor(x, y, true);
+         int to = cellColor(x, y, false);
+         fb.setGridPixel(x, y, from);
+         if (to != from) {
+            fb.blendGridPixel(x, y, to, alpha);
+         }
+      }
+   }
+   fb.showWithLimit();
+}
+
+int AutomatonRoutine::cellColor(int x, int y, bool previous) {
+   const int *palette = automatonPalettes[data->ca.rule];
+   int state = data->ca.state(x, y, previous);
+   if (data->ca.rule == CellularAutomaton::RULE_CYCLIC) {
+      return palette[state];
+   }
+   return state ? palette[data->ca.age(x, y, previous)] : 0;
+}
@@ -0,0 +1,77 @@
+/*
+ * automaton.h
+ *
+ * Cellular automata on a packed grid: a bit per cell in 32-bit words, a
+ * row at a time, so a generation works out 32 cells at once with word
+ * operations. The neighbours of every cell in a word are the word's rows
+ * above and below, shifted a bit each way; their count is added up
+ * bit-sliced (a word of ones, of twos, of fours, of eights), and the rule
+ * is logic on those words. The grid wraps around at the edges.
+ *
+ * Each generation is a few planes of bits: two of state, and two of age
+ * (how many generations the cell has kept its state, up to 3). There are
+ * two generations, the latest and the one before, for drawing the change
+ * between them. The storage is the caller's, so a routine can use its
+ * state buffer for a small canvas, or a static one for a big one.
+ */
+
+#pragma once
+
+#include <stdint.h>
+
+
+class CellularAutomaton {
+public:
+   typedef enum {
+      RULE_LIFE,   // Conway's: born with 3 neighbours, survives with 2 or 3
+      RULE_BRAIN,  // Brian's Brain: born with 2, on for a generation, then dying for one
+      RULE_CYCLIC, // 4 states; a cell moves on when enough neighbours are a state ahead
+      NUM_RULES
+   } Rule;
+
+   static const int statePlanes = 2;
+   static const int agePlanes = 2;
+   static const int planesPerGeneration = statePlanes + agePlanes;
+   static const int maxAge = 3;
+   static const int cyclicStates = 4;
+   static const int cyclicThreshold = 3;
+
+   static constexpr int wordsPerRow(int width) {
+      return (width + 31) / 32;
+   }
+   // how much storage a grid needs, in words
+   static constexpr int storageWords(int width, int height) {
+      return 2 * planesPerGeneration * height * wordsPerRow(width);
+   }
+
+   void begin(uint32_t *storage, int width, int height, Rule rule);
+   // random cells; density is how many of 256 aren't empty (cyclic
+   // cells are all some state, so there it's how many of 256 are random)
+   void seed(int density);
+   // the next generation; returns how many cells changed
+   int step();
+
+   // 0 for empty; for Life, 1 is alive; for Brian's Brain, 1 on and 2
+   // dying; for cyclic, 0 - 3 around the cycle
+   int state(int x, int y, bool previous = false);
+   int age(int x, int y, bool previous = false);
+
+   Rule rule;
+   int width;
+   int height;
+   int stride;            // words per row
+   uint32_t lastMask;     // the bits of the last word of a row that are cells
+   uint32_t *latest;      // planes, each height rows of stride words
+   uint32_t *previous;
+   uint32_t generation;
+
+private:
+   uint32_t *plane(uint32_t *planes, int p) {
+      return planes + p * height * stride;
+   }
+   int bit(uint32_t *planes, int p, int x, int y) {
+      return (plane(planes, p)[y * stride + x / 32] >> (x & 31)) & 1;
+   }
+   void rowsAround(uint32_t *plane, int y, uint32_t *rows[3]);
+   void neighbours(uint32_t *rows[3], int j, uint32_t n[8]);
+};
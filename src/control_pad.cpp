@@ -2,30 +2,72 @@
 #include "defs.h"
 #include "routine.h"
 #include "scene.h"
+#include "gesture.h"
 #include "control_pad.h"
+#include "profile.h"
 
 extern Scene scene;
 
+
+// attachInterrupt takes no argument, so one handler per button
+template<int index> static void onPinChange() {
+   controls.buttons[index].onEdge(index);
+}
+
+static void (* const pinChangeHandlers[])() = {
+   onPinChange<0>, onPinChange<1>, onPinChange<2>, onPinChange<3>, onPinChange<4>,
+};
+static_assert(ARRAYSIZE(pinChangeHandlers) == ARRAYSIZE(controls.buttons),
+              "need a pin change handler per button");
+
+
 void ControlPad::begin(int pinModePrev, int pinModeNext,
                        int pinParamPrev, int pinParamNext,
                        int pinSpeed, bool needPullup)
 {
+   events.head = events.tail = 0;
+   events.dropped = 0;
+
    numButtons = 0;
    buttons[numButtons++].begin(pinModeNext, needPullup, Scene::ACTION_MODE, 1);
    buttons[numButtons++].begin(pinModePrev, needPullup, Scene::ACTION_MODE, -1);
    buttons[numButtons++].begin(pinParamNext, needPullup, Scene::ACTION_PARAM, 1);
    buttons[numButtons++].begin(pinParamPrev, needPullup, Scene::ACTION_PARAM, -1);
    buttons[numButtons++].begin(pinSpeed, needPullup, Scene::ACTION_SPEED, 1);
+
+   for (int i = 0; i < numButtons; i++) {
+      if (buttons[i].pin) {
+         attachInterrupt(digitalPinToInterrupt(buttons[i].pin), pinChangeHandlers[i], CHANGE);
+      }
+   }
 }
 
 
 void ControlPad::sample(void) {
    for (int i = 0; i < numButtons; i++) {
-      InputButton *button = buttons + i;
-      bool pressed;
-      if (button->getChange(&pressed)) { // should change this to getChange, report both press and release
-         // onTimer wants release
-         scene.onButton(button->action, pressed, button->param);
+      buttons[i].resync(i);
+   }
+
+   InputEvent event;
+   while (events.pop(&event)) {
+      InputButton *button = buttons + event.button;
+      uint32_t age = micros() - event.time;
+      profiler.record(PROFILE_INPUT_LATE, age);
+
+      // scene timing is in ms; convert by age, which survives micros() wrapping
+      long time = millis() - age / 1000;
+      Gesture gesture;
+      if (button->gestures.onChange(event.pressed, time, &gesture)) {
+         scene.onGesture(button->action, &gesture, button->param);
+      }
+   }
+
+   // and holds, which happen by not changing
+   long now = millis();
+   for (int i = 0; i < numButtons; i++) {
+      Gesture gesture;
+      if (buttons[i].gestures.poll(now, &gesture)) {
+         scene.onGesture(buttons[i].action, &gesture, buttons[i].param);
       }
    }
 }
@@ -36,6 +78,9 @@ void InputButton::begin(int pin, bool needPullup, Scene::Action action, int para
    this->action = action;
    this->param = param;
    this->wasPressed = FALSE;
+   this->lastEdge = micros() - debounceMicros;
+   this->needsResync = FALSE;
+   gestures.begin(action == Scene::ACTION_SPEED);
 
    if (pin) {
       int mode = needPullup ? INPUT_PULLUP : INPUT;
@@ -48,24 +93,77 @@ bool InputButton::isPressed() {
    if (!pin) {
       return FALSE;
    }
-   // DebugPrint("InputButton sample pin %d result %d\n", pin, (int) digitalRead(pin));
    return digitalRead(pin) == LOW;
 }
 
 
-bool InputButton::getChange(bool *out) {
+void InputButton::onEdge(int index) {
+   uint32_t now = micros();
+   bool settled = now - lastEdge >= debounceMicros;
+   lastEdge = now;
+
    bool pressed = isPressed();
-   if (wasPressed) {
-      if (!pressed) {
-         *out = wasPressed = FALSE;
-         return TRUE;
-      }
+   if (settled && pressed != wasPressed) {
+      wasPressed = pressed;
+      controls.events.push(now, index, pressed);
    } else {
-      if (pressed) {
-         *out = wasPressed = TRUE;
-         return TRUE;
+      // bounce, or an edge back we missed; look again once it's quiet
+      needsResync = TRUE;
+   }
+}
+
+
+void InputButton::resync(int index) {
+   // A glitch shorter than the debounce time is taken as an edge, and the
+   // edge back ignored; so once things have been quiet a while after an
+   // ignored edge, check the pin really is where we last said. Only then:
+   // the pin isn't read on every pass of the loop. Interrupts are off for
+   // this, so the queue still has the one producer at a time.
+   if (!needsResync || micros() - lastEdge < debounceMicros) {
+      return;
+   }
+
+   noInterrupts();
+   if (needsResync && micros() - lastEdge >= debounceMicros) {
+      needsResync = FALSE;
+      bool pressed = isPressed();
+      if (pressed != wasPressed) {
+         // it got there at the last edge
+         wasPressed = pressed;
+         controls.events.push(lastEdge, index, pressed);
       }
    }
+   interrupts();
+}
+
+
+bool InputEventQueue::push(uint32_t time, int button, bool pressed) {
+   uint8_t next = (head + 1) & (size - 1);
+   if (next == tail) {
+      dropped++;
+      return false;
+   }
+
+   InputEvent *event = events + head;
+   event->time = time;
+   event->button = button;
+   event->pressed = pressed;
+
+   // the event has to be written before the consumer can see it
+   __sync_synchronize();
+   head = next;
+   return true;
+}
+
+
+bool InputEventQueue::pop(InputEvent *event) {
+   if (tail == head) {
+      return false;
+   }
 
-   return FALSE;
+   __sync_synchronize();
+   *event = events[tail];
+   __sync_synchronize();
+   tail = (tail + 1) & (size - 1);
+   return true;
 }
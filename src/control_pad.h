@@ -1,16 +1,57 @@
 #pragma once
 
+/*
+ * Buttons are read from pin-change interrupts, debounced there, and queued
+ * as timestamped press/release events; ControlPad::sample drains the queue
+ * from the main loop, works out gestures (see gesture.h) and hands those to
+ * the scene. So a press is timed when it happens, however long the loop
+ * happens to be busy drawing.
+ */
+
+typedef struct {
+   uint32_t time; // micros() when the button changed
+   uint8_t button;
+   bool pressed;
+} InputEvent;
+
+
+/*
+ * Single producer (the interrupt handlers), single consumer (the main
+ * loop), so no locks: each side only writes its own index.
+ */
+class InputEventQueue {
+public:
+   static const int size = 32; // power of 2
+
+   bool push(uint32_t time, int button, bool pressed); // false if full
+   bool pop(InputEvent *event);                        // false if empty
+
+   InputEvent events[size];
+   volatile uint8_t head; // next to write
+   volatile uint8_t tail; // next to read
+   volatile uint32_t dropped;
+};
+
+
 class InputButton {
 public:
+   // Edges closer together than this are bounce: the first edge after a
+   // quiet spell is taken at once, and the rest ignored till it settles.
+   static const uint32_t debounceMicros = 10000;
+
    void begin(int pin, bool needPullup, Scene::Action action, int param);
 
    int pin;
    Scene::Action action;
    int param;
-   bool wasPressed;
+   volatile bool wasPressed; // as last reported
+   volatile uint32_t lastEdge;
+   volatile bool needsResync; // an edge was ignored, so the pin may not be where we said
+   GestureRecognizer gestures;
 
    bool isPressed();
-   bool getChange(bool *pressed);
+   void onEdge(int index); // from the interrupt handler
+   void resync(int index); // from the loop, for edges onEdge couldn't take
 };
 
 
@@ -23,6 +64,7 @@ public:
 
    int numButtons;
    InputButton buttons[5];
+   InputEventQueue events;
 };
 
 
@@ -0,0 +1,56 @@
+#include <Arduino.h>
+#include "defs.h"
+#include "debuglog.h"
+#include "telemetry.h"
+
+
+/*
+ * Format strings already sent, so each goes out once: a small open-address
+ * set keyed by address. If it fills up, forget them all and send them again
+ * as they come up, which also helps a decoder that started listening late.
+ */
+static const int numSentFormats = 32; // power of 2
+static const char *sentFormats[numSentFormats];
+static int numSent = 0;
+
+static bool formatSent(const char *format) {
+   int slot = ((uintptr_t)format >> 2) & (numSentFormats - 1);
+   for (int i = 0; i < numSentFormats; i++) {
+      const char *sent = sentFormats[slot];
+      if (sent == format) return true;
+      if (!sent) return false;
+      slot = (slot + 1) & (numSentFormats - 1);
+   }
+   return false;
+}
+
+static void rememberFormat(const char *format) {
+   if (numSent >= numSentFormats * 3 / 4) {
+      memset(sentFormats, 0, sizeof sentFormats);
+      numSent = 0;
+   }
+
+   int slot = ((uintptr_t)format >> 2) & (numSentFormats - 1);
+   while (sentFormats[slot]) {
+      slot = (slot + 1) & (numSentFormats - 1);
+   }
+   sentFormats[slot] = format;
+   numSent++;
+}
+
+void debugLogSend(const char *format, DebugLogRecord *record) {
+   if (!formatSent(format)) {
+      TelemetryLogFormat formatRecord;
+      int length = strnlen(format, sizeof formatRecord.text);
+      formatRecord.format = (uintptr_t)format;
+      memcpy(formatRecord.text, format, length);
+      if (!telemetrySend(TELEMETRY_LOG_FORMAT, &formatRecord, sizeof formatRecord.format + length)) {
+         return; // no room; the message would be undecodable anyway
+      }
+      rememberFormat(format);
+   }
+
+   record->time = micros();
+   record->format = (uintptr_t)format;
+   telemetrySend(TELEMETRY_LOG, record, offsetof(DebugLogRecord, args) + record->argLength);
+}
@@ -0,0 +1,69 @@
+/*
+ * debuglog.h
+ *
+ * DebugPrint without the printf. Each call queues the format string's
+ * address, a timestamp and the raw arguments as a telemetry record (see
+ * telemetry.h), and tools/telemetry.py does the formatting on the host. The
+ * format string itself goes out once, the first time it's used.
+ *
+ * Arguments are packed by C++ type and unpacked by the decoder according
+ * to the format, so the two have to agree: integers (up to 32 bits) for
+ * %d, %u, %x, %c and the like; const char * for %s (copied, up to 31
+ * chars); float or double for %f, %e, %g (sent as float).
+ *
+ * Call from the main loop only, not from interrupt handlers.
+ */
+
+#pragma once
+
+#include <stdint.h>
+#include <string.h>
+
+class DebugLogRecord {
+public:
+   static const int maxArgBytes = 200;
+   static const int maxStringLength = 31;
+
+   void add(int value)           { addBytes(&value, 4); }
+   void add(unsigned value)      { addBytes(&value, 4); }
+   void add(long value)          { add((int)value); }
+   void add(unsigned long value) { add((unsigned)value); }
+   void add(double value)        { float f = value; addBytes(&f, 4); }
+   void add(const char *value) {
+      uint8_t n = strnlen(value, maxStringLength);
+      addBytes(&n, 1);
+      addBytes(value, n);
+   }
+
+   void addBytes(const void *bytes, int n) {
+      if (argLength + n > maxArgBytes) return; // truncated; the decoder will say so
+      memcpy(args + argLength, bytes, n);
+      argLength += n;
+   }
+
+   // payload is everything up to args + argLength
+   uint32_t time;    // us
+   uint32_t format;  // address of the format string
+   uint8_t args[maxArgBytes];
+   int argLength;
+};
+
+inline void debugLogPack(DebugLogRecord *record) {
+}
+
+template<typename T, typename... Rest>
+inline void debugLogPack(DebugLogRecord *record, T first, Rest... rest) {
+   record->add(first);
+   debugLogPack(record, rest...);
+}
+
+// Stamp and queue a packed record (sending the format first, if needed).
+void debugLogSend(const char *format, DebugLogRecord *record);
+
+template<typename... Args>
+inline void debugLog(const char *format, Args... args) {
+   DebugLogRecord record;
+   record.argLength = 0;
+   debugLogPack(&record, args...);
+   debugLogSend(format, &record);
+}
@@ -10,6 +10,9 @@ typedef char BOOL;
 
 #define ARRAYSIZE(a) ((sizeof(a) / sizeof(a[0])))
 
+// for wrapping timestamps (micros() wraps every 71 minutes)
+#define DEADLINE_REACHED(deadline, now) ((int32_t)((now) - (deadline)) >= 0)
+
 
 /*
  * Debugging helpers
@@ -18,15 +21,13 @@ typedef char BOOL;
 #define DEBUG 1
 
 #if DEBUG
-#define DebugPrint(...) {                        \
-   char buf[200];                                \
-   snprintf(buf, ARRAYSIZE(buf), __VA_ARGS__);   \
-   Serial.print(buf);                            \
-}
+// queued as binary and formatted on the host, see debuglog.h
+#include "debuglog.h"
+#define DebugPrint(...) debugLog(__VA_ARGS__)
 
 #else
 
-#define DebugPrint(x)
+#define DebugPrint(...)
 
 #endif
 
@@ -2,6 +2,8 @@
 #include "defs.h"
 #include "framebuffer.h"
 #include "platform.h"
+#include "profile.h"
+#include "raster.h"
 
 
 /*
@@ -10,27 +12,503 @@
 static const int ledsPerActualStrip = FB_PHYSICAL_HEIGHT;
 static const int ledStripConfig = WS2811_GRB | WS2811_800kHz;
 
-static_assert(ledsPerActualStrip * 8 == FB_VIRTUAL_WIDTH * FB_VIRTUAL_HEIGHT,
+static_assert(FB_LAYOUT.stripLength == ledsPerActualStrip,
+              "Framebuffer layout strip length mismatch");
+static_assert(layoutFitsStrip(FB_LAYOUT),
+              "Framebuffer layout segments don't fit in strip");
+static_assert(layoutWidth(FB_LAYOUT) == FB_VIRTUAL_WIDTH &&
+              layoutHeight(FB_LAYOUT) == FB_VIRTUAL_HEIGHT,
               "Framebuffer virtual/physical layout mismatch");
 
-// XXX this is a poor version of FB_LAYOUT, only supporting the cases I
-// need, which is 8 * x and 16 * x.
-static const int stripsPerVStrip = FB_VIRTUAL_WIDTH / FB_PHYSICAL_WIDTH;
+/*
+ * Grid to LED index lookup, generated at compile time from FB_LAYOUT, so
+ * addressing a pixel is a single table load. Indexed by y * width + x.
+ */
+static const int numGridPixels = FB_VIRTUAL_WIDTH * FB_VIRTUAL_HEIGHT;
+
+template<class> struct GridTable;
+template<int... I> struct GridTable<IndexList<I...> > {
+   static const uint16_t ledIndex[sizeof...(I)];
+};
+template<int... I> const uint16_t GridTable<IndexList<I...> >::ledIndex[sizeof...(I)] = {
+   layoutLedIndex(FB_LAYOUT, I % FB_VIRTUAL_WIDTH, I / FB_VIRTUAL_WIDTH)...
+};
+
+static const uint16_t *const gridToLed = GridTable<MakeIndexList<numGridPixels>::Type>::ledIndex;
+
+/*
+ * LED index step along each column and row (0 if it isn't a straight run),
+ * so spans can be written with a pointer increment instead of a lookup.
+ */
+template<class> struct StrideTables;
+template<int... I> struct StrideTables<IndexList<I...> > {
+   static const int16_t column[sizeof...(I)];
+   static const int16_t row[sizeof...(I)];
+};
+template<int... I> const int16_t StrideTables<IndexList<I...> >::column[sizeof...(I)] = {
+   layoutColumnStride(FB_LAYOUT, I)...
+};
+template<int... I> const int16_t StrideTables<IndexList<I...> >::row[sizeof...(I)] = {
+   layoutRowStride(FB_LAYOUT, I)...
+};
+
+static const int16_t *const columnStride = StrideTables<MakeIndexList<FB_VIRTUAL_WIDTH>::Type>::column;
+static const int16_t *const rowStride = StrideTables<MakeIndexList<FB_VIRTUAL_HEIGHT>::Type>::row;
+
+/*
+ * Pixel formats for the working buffer. Routines always hand us 0xRRGGBB
+ * ints, but with FB_DEEP_COLOR (platform.h) each LED is kept at 16 bits per
+ * channel, so fades and blends accumulate without rounding to 8 bits every
+ * frame; the extra bits are only dropped when the frame is encoded.
+ *
+ * Each format packs its channels so the same SWAR tricks work on it: red
+ * and blue share one multiply, green gets the other.
+ */
+template<bool deep> struct PixelFormat;
+
+// 8 bits per channel, 0x00RRGGBB
+template<> struct PixelFormat<false> {
+   typedef uint32_t Pixel;
+   static const int channelBits = 8;
+   static const int redShift = 16;
+   static const int greenShift = 8;
+   static const uint32_t channelMask = 0xFF;
+   static const uint32_t rbMask = 0xFF00FF;
+   static const uint32_t gMask = 0x00FF00;
+
+   static inline Pixel fromColor(int color) {
+      return color & 0xFFFFFF;
+   }
+   static inline int toColor(Pixel pixel) {
+      return pixel;
+   }
+
+   // Per-channel a - b, saturating at 0.
+   static inline Pixel subtractSaturating(Pixel a, Pixel b) {
+      uint32_t diff = ((a | 0x808080) - (b & 0x7F7F7F)) ^ ((a ^ ~b) & 0x808080);
+      uint32_t borrow = ((~a & b) | (~(a ^ b) & diff)) & 0x808080;
+      return diff & ~((borrow << 1) - (borrow >> 7)) & 0xFFFFFF;
+   }
+
+   // For whole-screen passes: red and blue summed together in 16-bit lanes,
+   // flushed before they can overflow (256 * 0xFF < 0x10000).
+   typedef uint32_t PackedLanes;
+   static const int laneShift = 16;
+   static const int sumsFlushInterval = 256;
+};
+
+// 16 bits per channel, 0x0000RRRRGGGGBBBB; 8-bit c is stored as c * 0x101,
+// so 0xFF is full scale either way.
+template<> struct PixelFormat<true> {
+   typedef uint64_t Pixel;
+   static const int channelBits = 16;
+   static const int redShift = 32;
+   static const int greenShift = 16;
+   static const uint32_t channelMask = 0xFFFF;
+   static const uint64_t rbMask = 0x0000FFFF0000FFFFULL;
+   static const uint64_t gMask = 0x00000000FFFF0000ULL;
+
+   static inline Pixel fromColor(int color) {
+      return (((uint64_t)(color & 0xFF0000) << 16) | ((color & 0x00FF00) << 8) | (color & 0xFF)) * 0x101;
+   }
+   static inline int toColor(Pixel pixel) {
+      return ((pixel >> 24) & 0xFF0000) | ((pixel >> 16) & 0x00FF00) | ((pixel >> 8) & 0xFF);
+   }
+
+   static inline Pixel subtractSaturating(Pixel a, Pixel b) {
+      uint64_t diff = ((a | 0x800080008000ULL) - (b & 0x7FFF7FFF7FFFULL)) ^ ((a ^ ~b) & 0x800080008000ULL);
+      uint64_t borrow = ((~a & b) | (~(a ^ b) & diff)) & 0x800080008000ULL;
+      return diff & ~((borrow << 1) - (borrow >> 15)) & 0xFFFFFFFFFFFFULL;
+   }
+
+   // red and blue in 32-bit lanes: never overflows within a strip
+   typedef uint64_t PackedLanes;
+   static const int laneShift = 32;
+   static const int sumsFlushInterval = 65536;
+};
+
+typedef PixelFormat<FB_DEEP_COLOR> Format;
+typedef Format::Pixel Pixel;
+
+// channel value of one 8-bit step (1 or 0x101)
+static const int channelUnit = Format::channelMask / 0xFF;
+
+static inline int redOf(Pixel pixel) {
+   return (pixel >> Format::redShift) & Format::channelMask;
+}
+
+static inline int greenOf(Pixel pixel) {
+   return (pixel >> Format::greenShift) & Format::channelMask;
+}
+
+static inline int blueOf(Pixel pixel) {
+   return pixel & Format::channelMask;
+}
+
+// Scale each channel by scale/256 (0 <= scale <= 256).
+static inline Pixel scaleChannels(Pixel pixel, uint32_t scale) {
+   Pixel rb = ((pixel & Format::rbMask) * scale >> 8) & Format::rbMask;
+   Pixel g = ((pixel & Format::gMask) * scale >> 8) & Format::gMask;
+   return rb | g;
+}
+
+// r + g + b
+static inline int sumChannels(Pixel pixel) {
+   return redOf(pixel) + greenOf(pixel) + blueOf(pixel);
+}
+
 
 /*
  * Framebuffers
+ *
+ * Routines draw into pixelMemory, one Pixel per LED, in LED order (strip by
+ * strip). OctoWS2811 wants its drawing buffer bit-transposed (each byte
+ * holds one bit of one color channel for all 8 strips), and encoding that
+ * one pixel at a time via leds.setPixel/getPixel is slow, so instead we
+ * convert the whole frame in one pass when it's shown.
+ *
+ * The encoded frame and the one being sent are a ping-pong pair: we encode
+ * into drawingMemory while DMA reads displayMemory, and leds.show() copies
+ * one to the other to start the next transfer. It only blocks if the last
+ * transfer is still going, so we don't call it until it isn't (see
+ * present()); meanwhile routines carry on with the next frame.
  */
 
-DMAMEM byte displayMemory[ledsPerActualStrip * 24];
-byte drawingMemory[ledsPerActualStrip * 24];
+static const int numLeds = ledsPerActualStrip * 8;
+
+Pixel pixelMemory[numLeds];
+DMAMEM int displayMemory[ledsPerActualStrip * 6];
+int drawingMemory[ledsPerActualStrip * 6];
 OctoWS2811 leds(ledsPerActualStrip, displayMemory, drawingMemory, ledStripConfig);
 
 
+/*
+ * Running per-strip, per-channel totals over pixelMemory, in the working
+ * format's units. Every write goes through storePixel (or a bulk operation
+ * that recomputes them in the same pass), so the power limiter can decide
+ * whether to act without scanning the frame.
+ */
+static const int numStrips = FB_LAYOUT_NUM_STRIPS;
+
+typedef struct {
+   long r;
+   long g;
+   long b;
+} ChannelSums;
+static ChannelSums stripSums[numStrips];
+
+static inline void addToSums(ChannelSums *sums, Pixel pixel) {
+   sums->r += redOf(pixel);
+   sums->g += greenOf(pixel);
+   sums->b += blueOf(pixel);
+}
+
+/*
+ * Dirty tracking: the range of positions along the strips (rows of the
+ * encoded buffer) written since the last show(). The encoder transposes a
+ * whole row, all 8 strips, at a time, so that's the unit of re-encoding.
+ */
+static int dirtyFirst = 0;
+static int dirtyLast = ledsPerActualStrip - 1;
+
+static inline void markDirty(int offset) {
+   if (offset < dirtyFirst) dirtyFirst = offset;
+   if (offset > dirtyLast) dirtyLast = offset;
+}
+
+static inline void markAllDirty() {
+   dirtyFirst = 0;
+   dirtyLast = ledsPerActualStrip - 1;
+}
+
+static inline void markAllClean() {
+   dirtyFirst = ledsPerActualStrip;
+   dirtyLast = -1;
+}
+
+// drawingMemory holds a frame that hasn't gone to the LEDs yet
+static bool presentPending = false;
+
+static inline void storePixel(int index, Pixel pixel) {
+   int strip = index / ledsPerActualStrip;
+   ChannelSums *sums = stripSums + strip;
+   Pixel old = pixelMemory[index];
+   if (pixel == old) return;
+
+   markDirty(index - strip * ledsPerActualStrip);
+   sums->r += redOf(pixel) - redOf(old);
+   sums->g += greenOf(pixel) - greenOf(old);
+   sums->b += blueOf(pixel) - blueOf(old);
+   pixelMemory[index] = pixel;
+}
+
+// Store count pixels of one color, starting at LED index and stride apart.
+// Runs along a strip are accounted for in one go; anything else (a run
+// across strips) pixel by pixel.
+static void storeRun(int index, int stride, int count, Pixel pixel) {
+   int last = index + stride * (count - 1);
+   int first = min(index, last);
+   int strip = first / ledsPerActualStrip;
+
+   if (abs(stride) != 1 || max(index, last) / ledsPerActualStrip != strip) {
+      for (int i = 0; i < count; i++, index += stride) {
+         storePixel(index, pixel);
+      }
+      return;
+   }
+
+   ChannelSums *sums = stripSums + strip;
+   ChannelSums old = { 0, 0, 0 };
+   Pixel *p = pixelMemory + first;
+   for (int i = 0; i < count; i++) {
+      addToSums(&old, p[i]);
+      p[i] = pixel;
+   }
+   sums->r += (long)redOf(pixel) * count - old.r;
+   sums->g += (long)greenOf(pixel) * count - old.g;
+   sums->b += (long)blueOf(pixel) * count - old.b;
+
+   int offset = first - strip * ledsPerActualStrip;
+   markDirty(offset);
+   markDirty(offset + count - 1);
+}
+
+// For whole-screen passes: accumulate red and blue together in one word,
+// flushing into the strip totals before the lanes can overflow.
+typedef struct {
+   Format::PackedLanes rb;
+   uint32_t g;
+} PackedSums;
+
+static inline void addToPackedSums(PackedSums *acc, Pixel pixel) {
+   acc->rb += pixel & Format::rbMask;
+   acc->g += greenOf(pixel);
+}
+
+static inline void flushPackedSums(PackedSums *acc, ChannelSums *sums) {
+   sums->r += acc->rb >> Format::laneShift;
+   sums->g += acc->g;
+   sums->b += acc->rb & (((Format::PackedLanes)1 << Format::laneShift) - 1);
+   acc->rb = acc->g = 0;
+}
+
+static const int packedSumsFlushInterval = Format::sumsFlushInterval;
+
+
+/*
+ * SWAR kernels on 0xRRGGBB ints, for the color math routines do on their
+ * own values (the Teensy 3.0 has no FPU).
+ */
+
+// Scale each channel by scale/256 (0 <= scale <= 256).
+static inline uint32_t scaleColor(uint32_t color, uint32_t scale) {
+   uint32_t rb = ((color & 0xFF00FF) * scale >> 8) & 0xFF00FF;
+   uint32_t g = ((color & 0x00FF00) * scale >> 8) & 0x00FF00;
+   return rb | g;
+}
+
+// Per-channel a + b, saturating at 0xFF.
+static inline uint32_t addChannelsSaturating(uint32_t a, uint32_t b) {
+   uint32_t low = (a & 0x7F7F7F) + (b & 0x7F7F7F);
+   uint32_t sum = low ^ ((a ^ b) & 0x808080);
+   uint32_t carry = ((a & b) | ((a ^ b) & low)) & 0x808080;
+   return sum | ((carry << 1) - (carry >> 7));
+}
+
+
+/*
+ * Power model. Current per strip is idle draw for every LED plus a
+ * per-channel cost for each unit of brightness (FB_POWER, in platform.h).
+ * When limiting, each strip is scaled to fit its own budget, and all of
+ * them together to fit the supply; the scaling is done as the frame is
+ * encoded. Brightness is taken before the output gamma, so with FB_GAMMA
+ * above 1 the estimate errs high.
+ */
+static const long idleMicroampsPerStrip = (long)FB_POWER.idleMicroampsPerLed * ledsPerActualStrip;
+
+static uint16_t stripScale[numStrips]; // 256 == full brightness
+
+static inline long dynamicMicroamps(const ChannelSums *sums) {
+   return (sums->r * FB_POWER.redMicroampsPerUnit
+         + sums->g * FB_POWER.greenMicroampsPerUnit
+         + sums->b * FB_POWER.blueMicroampsPerUnit) / channelUnit;
+}
+
+// Fraction (of 256) of wanted that fits in allowed.
+static inline uint32_t fitScale(long allowed, long wanted) {
+   if (wanted <= allowed) return 256;
+   if (allowed <= 0) return 0;
+   return (uint32_t)(((uint64_t)allowed << 8) / wanted);
+}
+
+// Work out each strip's scale (all 256 unless limit) and return the
+// estimated current in mA.
+static int planStripScales(bool limit) {
+   long dynamic[numStrips];
+   long dynamicTotal = 0;
+   for (int s = 0; s < numStrips; s++) {
+      dynamic[s] = dynamicMicroamps(stripSums + s);
+      dynamicTotal += dynamic[s];
+   }
+
+   long stripAllowed = FB_POWER.stripBudgetMilliamps * 1000L - idleMicroampsPerStrip;
+   long totalAllowed = FB_POWER.totalBudgetMilliamps * 1000L - idleMicroampsPerStrip * numStrips;
+   uint32_t totalScale = limit ? fitScale(totalAllowed, dynamicTotal) : 256;
+
+   long microamps = idleMicroampsPerStrip * numStrips;
+   for (int s = 0; s < numStrips; s++) {
+      uint32_t scale = limit ? min(totalScale, fitScale(stripAllowed, dynamic[s])) : 256;
+      stripScale[s] = scale;
+      microamps += (dynamic[s] >> 8) * scale;
+   }
+   return microamps / 1000;
+}
+
+/*
+ * Transpose 8 bytes (one per strip; strips 0-3 in lo, 4-7 in hi) so that
+ * output byte k holds bit 7-k of every strip, which is the order the bits
+ * go out on the wire. See Hacker's Delight, "transpose8".
+ */
+static inline void transposeStrips(uint32_t lo, uint32_t hi, uint32_t *out) {
+   uint32_t t;
+
+   t = (lo ^ (lo >> 7)) & 0x00AA00AA; lo ^= t ^ (t << 7);
+   t = (hi ^ (hi >> 7)) & 0x00AA00AA; hi ^= t ^ (t << 7);
+   t = (lo ^ (lo >> 14)) & 0x0000CCCC; lo ^= t ^ (t << 14);
+   t = (hi ^ (hi >> 14)) & 0x0000CCCC; hi ^= t ^ (t << 14);
+   t = (lo ^ (hi << 4)) & 0xF0F0F0F0; lo ^= t; hi ^= t >> 4;
+
+   // msb-first: bit 7 (now byte 7, top of hi) goes out first
+   out[0] = __builtin_bswap32(hi);
+   out[1] = __builtin_bswap32(lo);
+}
+
+/*
+ * Output stage: a gamma curve, then temporal dithering down to 8 bits.
+ *
+ * The curve is a table in 8.8 fixed point, indexed by the top 8 bits of a
+ * channel (the deep format interpolates on the rest). Each LED then steps
+ * through 16 rounding thresholds in bit-reversed order, one per encode, so
+ * the fraction below the output LSB averages out over the refreshes sent
+ * between frames. Neighbours start at different points in the cycle so the
+ * whole screen doesn't flicker in step.
+ *
+ * Only rows with some fraction left over (curve values between two output
+ * levels) look any different from one set of thresholds to the next, so
+ * the encoder counts them, and refresh() doesn't bother when there are none.
+ */
+static uint16_t outputTable[257];
+static uint8_t ditherPhase;
+static bool ditherOn = FB_DITHER;
+static bool rowResidue[ledsPerActualStrip];
+static int residueRows;
+
+static const uint8_t ditherThresholds[16] = {
+   8, 136, 72, 200, 40, 168, 104, 232, 24, 152, 88, 216, 56, 184, 120, 248
+};
+
+static void buildOutputTable() {
+   for (int i = 0; i <= 256; i++) {
+      outputTable[i] = 0xFF00 * powf(min(i, 255) / 255.0f, FB_GAMMA) + 0.5f;
+   }
+}
+
+static inline uint32_t ditherThreshold(int strip, int offset) {
+   return ditherOn ? ditherThresholds[(ditherPhase + strip * 5 + offset * 3) & 15] : 0x80;
+}
+
+// the channel's output level; ORs what's below the output LSB into residue
+static inline uint32_t outputChannel(uint32_t value, uint32_t threshold, uint32_t *residue) {
+   const int fracBits = Format::channelBits - 8;
+   if (fracBits) {
+      value -= value >> 8; // 0xFFFF is full scale, and the table wants 0xFF00
+   }
+   uint32_t i = value >> fracBits;
+   uint32_t frac = value & ((1 << fracBits) - 1);
+   uint32_t out = outputTable[i] + ((outputTable[i + 1] - outputTable[i]) * frac >> fracBits);
+   *residue |= out & 0xFF;
+   return (out + threshold) >> 8;
+}
+
+// Convert the dirty rows of pixelMemory into OctoWS2811's drawing buffer
+// format, first scaling any strips being limited. Returns the number of
+// rows encoded.
+static int encodeFrame() {
+   bool limiting = false;
+
+   for (int s = 0; s < numStrips; s++) {
+      if (stripScale[s] < 256) {
+         memset(stripSums + s, 0, sizeof stripSums[s]);
+         limiting = true;
+      }
+   }
+   if (limiting) {
+      // scaling rewrites every pixel on the limited strips
+      markAllDirty();
+   }
+
+   uint32_t *out = (uint32_t *)drawingMemory + dirtyFirst * 6;
+   for (int offset = dirtyFirst; offset <= dirtyLast; offset++) {
+      // one byte per strip, strips 0-3 in [0] and 4-7 in [1]
+      uint32_t red[2] = { 0, 0 };
+      uint32_t green[2] = { 0, 0 };
+      uint32_t blue[2] = { 0, 0 };
+      uint32_t residue = 0;
+
+      Pixel *p = pixelMemory + offset;
+      for (int s = 0; s < numStrips; s++, p += ledsPerActualStrip) {
+         Pixel pixel = *p;
+         if (stripScale[s] < 256) {
+            pixel = *p = scaleChannels(pixel, stripScale[s]);
+            addToSums(stripSums + s, pixel);
+         }
+
+         uint32_t threshold = ditherThreshold(s, offset);
+         int shift = (s & 3) * 8;
+         red[s >> 2] |= outputChannel(redOf(pixel), threshold, &residue) << shift;
+         green[s >> 2] |= outputChannel(greenOf(pixel), threshold, &residue) << shift;
+         blue[s >> 2] |= outputChannel(blueOf(pixel), threshold, &residue) << shift;
+      }
+      residueRows += (residue != 0) - rowResidue[offset];
+      rowResidue[offset] = residue != 0;
+
+      // WS2811_GRB: green goes out first
+      transposeStrips(green[0], green[1], out);
+      transposeStrips(red[0], red[1], out + 2);
+      transposeStrips(blue[0], blue[1], out + 4);
+      out += 6;
+   }
+
+   // the limited strips are now within budget as they stand
+   for (int s = 0; s < numStrips; s++) {
+      stripScale[s] = 256;
+   }
+   ditherPhase++;
+
+   int rows = max(dirtyLast - dirtyFirst + 1, 0);
+   markAllClean();
+   return rows;
+}
+
 Framebuffer::Framebuffer() {
    this->width = FB_VIRTUAL_WIDTH;
    this->height = FB_VIRTUAL_HEIGHT;
    this->ledsPerStrip = ledsPerActualStrip;
    this->numPixels = width * height;
+   // 24 bits at 800 kHz per LED, all strips in parallel, then the latch
+   this->transmitMicros = ledsPerActualStrip * 30 + 300;
+   this->frameMilliamps = 0;
+   resetStats();
+   buildOutputTable();
+}
+
+void Framebuffer::resetStats() {
+   framesSent = 0;
+   framesSkipped = 0;
+   rowsEncoded = 0;
+   framesDropped = 0;
+   refreshes = 0;
+   refreshMicros = 0;
 }
 
 void Framebuffer::begin() {
@@ -39,55 +517,73 @@ void Framebuffer::begin() {
 }
 
 void Framebuffer::setGridPixel(int x, int y, int color) {
-   if (x < 0 || x >= fb.width || y < 0 || y >= fb.height) return;
+   if (x < 0 || x >= FB_VIRTUAL_WIDTH || y < 0 || y >= FB_VIRTUAL_HEIGHT) return;
 
-   // XXX should provide way to customize this for arbitrary layout
-   // Right now, all I need is:
-   // - backpack: alternating strip direction (like FB_LAYOUT 0)
-   // - jacket: only 8 strips, but one side mirrors X
-   if (FB_MIRROR_X) {
-      x = fb.width - x - 1;
-   }
-   if (FB_MIRROR_Y) {
-      y = fb.height - y - 1;
-   }
-   int realStrip = x / stripsPerVStrip;
-   int realOffset = (x % stripsPerVStrip) ? y : ledsPerStrip - 1 - y;
+   storePixel(gridToLed[y * FB_VIRTUAL_WIDTH + x], Format::fromColor(color));
+}
+
+void Framebuffer::blendGridPixel(int x, int y, int color, int alpha) {
+   if (x < 0 || x >= FB_VIRTUAL_WIDTH || y < 0 || y >= FB_VIRTUAL_HEIGHT) return;
+   if (alpha <= 0) return;
 
-   leds.setPixel(realOffset + realStrip * ledsPerStrip, color);
+   int index = gridToLed[y * FB_VIRTUAL_WIDTH + x];
+   Pixel pixel = Format::fromColor(color);
+   if (alpha < 256) {
+      pixel = scaleChannels(pixelMemory[index], 256 - alpha) + scaleChannels(pixel, alpha);
+   }
+   storePixel(index, pixel);
 }
 
 int Framebuffer::getGridPixel(int x, int y) {
-   if (x < 0 || x >= fb.width || y < 0 || y >= fb.height) return 0;
+   if (x < 0 || x >= FB_VIRTUAL_WIDTH || y < 0 || y >= FB_VIRTUAL_HEIGHT) return 0;
 
-   // XXX should provide way to customize this for arbitrary layout
-   // Right now, all I need is:
-   // - backpack: alternating strip direction (like FB_LAYOUT 0)
-   // - jacket: only 8 strips, but one side mirrors X
-   if (FB_MIRROR_X) {
-      x = fb.width - x - 1;
+   return Format::toColor(pixelMemory[gridToLed[y * FB_VIRTUAL_WIDTH + x]]);
+}
+
+void Framebuffer::fillColumnSpan(int x, int y0, int y1, int color) {
+   if (y0 > y1) {
+      int t = y0; y0 = y1; y1 = t;
    }
-   if (FB_MIRROR_Y) {
-      y = fb.height - y - 1;
+   if (x < 0 || x >= FB_VIRTUAL_WIDTH) return;
+   y0 = max(y0, 0);
+   y1 = min(y1, FB_VIRTUAL_HEIGHT - 1);
+   if (y0 > y1) return;
+
+   const uint16_t *cell = gridToLed + y0 * FB_VIRTUAL_WIDTH + x;
+   if (columnStride[x]) {
+      storeRun(*cell, columnStride[x], y1 - y0 + 1, Format::fromColor(color));
+   } else {
+      for (int y = y0; y <= y1; y++, cell += FB_VIRTUAL_WIDTH) {
+         storePixel(*cell, Format::fromColor(color));
+      }
    }
-   int realStrip = x / stripsPerVStrip;
-   int realOffset = (x % stripsPerVStrip) ? y : ledsPerStrip - 1 - y;
+}
 
-   return leds.getPixel(realOffset + realStrip * ledsPerStrip);
+void Framebuffer::fillRowSpan(int y, int x0, int x1, int color) {
+   if (x0 > x1) {
+      int t = x0; x0 = x1; x1 = t;
+   }
+   if (y < 0 || y >= FB_VIRTUAL_HEIGHT) return;
+   x0 = max(x0, 0);
+   x1 = min(x1, FB_VIRTUAL_WIDTH - 1);
+   if (x0 > x1) return;
+
+   const uint16_t *cell = gridToLed + y * FB_VIRTUAL_WIDTH + x0;
+   if (rowStride[y]) {
+      storeRun(*cell, rowStride[y], x1 - x0 + 1, Format::fromColor(color));
+   } else {
+      for (int x = x0; x <= x1; x++, cell++) {
+         storePixel(*cell, Format::fromColor(color));
+      }
+   }
 }
 
 void Framebuffer::drawGridLine(int x0, int y0, int x1, int y1, int color) {
    int x, y;
    if (x0 == x1) { // vertical line
-      int dy = (y0 < y1) ? 1 : -1;
-      for (y = y0; y != y1 + dy; y += dy) {
-         setGridPixel(x0, y, color);
-      }
+      fillColumnSpan(x0, y0, y1, color);
    } else if (y0 == y1) { // horizontal
-      int dx = (x0 < x1) ? 1 : -1;
-      for (x = x0; x != x1 + dx; x += dx) {
-         setGridPixel(x, y0, color);
-      }
+      fillRowSpan(y0, x0, x1, color);
    } else if (abs(x1 - x0) == abs(y1 - y0)) { // 45 degree diagonal
       int xStep = (x1 > x0) ? 1 : -1;
       int yStep = (y1 > y0) ? 1 : -1;
@@ -123,16 +619,18 @@ void Framebuffer::drawGridLine(int x0, int y0, int x1, int y1, int color) {
    }
 }
 
-int Framebuffer::scalePixel(int pixel, float scale) {
-   int r = (pixel >> 16) & 0xFF;
-   int g = (pixel >> 8) & 0xFF;
-   int b = pixel & 0xFF;
+int Framebuffer::toFixedScale(float scale) {
+   if (scale <= 0) return 0;
+   if (scale >= 1) return 256;
+   return scale * 256 + 0.5;
+}
 
-   r *= scale;
-   g *= scale;
-   b *= scale;
+int Framebuffer::scalePixel(int pixel, float scale) {
+   return scaleColor(pixel, toFixedScale(scale));
+}
 
-   return r << 16 | g << 8 | b;
+int Framebuffer::scalePixelFixed(int pixel, int scale) {
+   return scaleColor(pixel, scale);
 }
 
 float Framebuffer::remap(float value, float from1, float from2, float to1, float to2) {
@@ -145,84 +643,162 @@ float Framebuffer::remap(float value, float from1, float from2, float to1, float
 }
 
 void Framebuffer::clearScreen() {
-   memset(drawingMemory, 0, 3 * numPixels);
+   for (int s = 0; s < numStrips; s++) {
+      if (stripSums[s].r || stripSums[s].g || stripSums[s].b) {
+         memset(pixelMemory, 0, sizeof pixelMemory);
+         memset(stripSums, 0, sizeof stripSums);
+         markAllDirty();
+         break;
+      }
+   }
 }
 
 void Framebuffer::fillScreen(int color) {
-   for (int i = 0; i < numPixels; i++) {
-      leds.setPixel(i, color);
+   // only the LEDs on the grid; the layout may leave some unused
+   Pixel pixel = Format::fromColor(color);
+   for (int i = 0; i < numGridPixels; i++) {
+      pixelMemory[gridToLed[i]] = pixel;
+   }
+   markAllDirty();
+
+   // (every strip carries the same number of grid pixels, and the unused
+   // LEDs are never written, so they're still black)
+   ChannelSums sums = { 0, 0, 0 };
+   addToSums(&sums, pixel);
+   for (int s = 0; s < numStrips; s++) {
+      stripSums[s].r = sums.r * (numGridPixels / numStrips);
+      stripSums[s].g = sums.g * (numGridPixels / numStrips);
+      stripSums[s].b = sums.b * (numGridPixels / numStrips);
    }
 }
 
 void Framebuffer::fadeScreenByStep(int fade, int base) {
-   for (int i = 0; i < numPixels; i++) {
-      int pixel = leds.getPixel(i);
-      int r = (pixel >> 16) & 0xFF;
-      int g = (pixel >> 8) & 0xFF;
-      int b = pixel & 0xFF;
-
-      if (r + g + b > base) {
-         r -= fade;
-         g -= fade;
-         b -= fade;
-         if (r < 0) r = 0;
-         if (g < 0) g = 0;
-         if (b < 0) b = 0;
+   Pixel step = Format::fromColor(min(max(fade, 0), 0xFF) * 0x010101);
+   base *= channelUnit;
+   Pixel *p = pixelMemory;
+   bool changed = false;
+   for (int s = 0; s < numStrips; s++) {
+      ChannelSums *sums = stripSums + s;
+      PackedSums acc = { 0, 0 };
+      memset(sums, 0, sizeof *sums);
+      for (int offset = 0; offset < ledsPerActualStrip; offset++, p++) {
+         Pixel pixel = *p;
+         if (sumChannels(pixel) > base) {
+            pixel = Format::subtractSaturating(pixel, step);
+            changed |= pixel != *p;
+            *p = pixel;
+         }
+         addToPackedSums(&acc, pixel);
+         if (offset % packedSumsFlushInterval == packedSumsFlushInterval - 1) {
+            flushPackedSums(&acc, sums);
+         }
       }
-
-      pixel = r << 16 | g << 8 | b;
-      leds.setPixel(i, pixel);
+      flushPackedSums(&acc, sums);
+   }
+   if (changed) {
+      markAllDirty();
    }
 }
 
 void Framebuffer::fadeScreenByScale(float scale) {
-   for (int i = 0; i < numPixels; i++) {
-      int pixel = leds.getPixel(i);
-      pixel = scalePixel(pixel, scale);
-      leds.setPixel(i, pixel);
+   fadeScreenByFixedScale(toFixedScale(scale));
+}
+
+void Framebuffer::fadeScreenByFixedScale(int scale) {
+   Pixel *p = pixelMemory;
+   bool changed = false;
+   for (int s = 0; s < numStrips; s++) {
+      ChannelSums *sums = stripSums + s;
+      PackedSums acc = { 0, 0 };
+      memset(sums, 0, sizeof *sums);
+      for (int offset = 0; offset < ledsPerActualStrip; offset++, p++) {
+         Pixel pixel = scaleChannels(*p, scale);
+         changed |= pixel != *p;
+         *p = pixel;
+         addToPackedSums(&acc, pixel);
+         if (offset % packedSumsFlushInterval == packedSumsFlushInterval - 1) {
+            flushPackedSums(&acc, sums);
+         }
+      }
+      flushPackedSums(&acc, sums);
+   }
+   if (changed) {
+      markAllDirty();
    }
 }
 
 
 void Framebuffer::showWithLimit() {
-   byte *start = (byte *)drawingMemory;
-   byte *end = start + 3 * numPixels;
-   byte *p;
-   int whichBit = 7;
-   int whichByte = 0;
-   unsigned long values[3] = { 0 };
-
-   // XXX I can't do this 24 bits at a time; need to do 8 (G R B separately), and sum or weighted-sum the results
-   for (p = start; p < end; p++) {
-      // count bits set in *p (Brian Kernighan's way, http://graphics.stanford.edu/~seander/bithacks.html#CountBitsSetKernighan)
-      int thisByte = *p;
-      int numSet;
-      for (numSet = 0; thisByte; numSet++) {
-         thisByte &= thisByte - 1; // clear least significant bit set
-      }
+   uint32_t start = micros();
+   // scale down to the power budget, in the same pass as encoding
+   frameMilliamps = planStripScales(true);
+   send();
+   profiler.record(PROFILE_SHOW, micros() - start);
+}
 
-      // depending on which virtual bit of the 24-bit cycle we're on, calculate this pixel's contribution to overall framebuffer brightness
-      values[whichByte] += (numSet << whichBit);
-    
-      whichBit = (whichBit + 7) % 8; // subract 1, mod 8, stay positive
-      if (whichBit == 7) { // wrapped around
-         whichByte = (whichByte + 1) % 3;
-      }
-   }
 
-   int value = values[0] + values[1] + values[2];
-   int limit = 0x4000; // XXX just a guess: 1/4 of maximum possible
+void Framebuffer::show() {
+   uint32_t start = micros();
+   frameMilliamps = planStripScales(false);
+   send();
+   profiler.record(PROFILE_SHOW, micros() - start);
+}
+
 
-   if (value > limit) {
-      fadeScreenByScale(1.0 * limit / value);
+void Framebuffer::send() {
+   int rows = encodeFrame();
+   if (!rows) {
+      // nothing changed since last time; the LEDs already have this frame
+      framesSkipped++;
+      return;
+   }
+
+   rowsEncoded += rows;
+   if (presentPending) {
+      // the LEDs never got the last one; this frame replaces it
+      framesDropped++;
    }
+   presentPending = true;
+   present();
+}
+
+
+void Framebuffer::present() {
+   if (!presentPending || leds.busy()) return;
 
    leds.show();
+   presentPending = false;
+   framesSent++;
 }
 
 
-void Framebuffer::show() {
+bool Framebuffer::transmitting() {
+   return leds.busy();
+}
+
+
+bool Framebuffer::framePending() {
+   return presentPending;
+}
+
+
+void Framebuffer::setDither(bool on) {
+   ditherOn = FB_DITHER && on;
+}
+
+
+bool Framebuffer::refresh() {
+   if (!ditherOn || !residueRows || presentPending || leds.busy()) return false;
+
+   // same frame, next set of dither thresholds
+   unsigned long start = micros();
+   markAllDirty();
+   encodeFrame();
    leds.show();
+
+   refreshes++;
+   refreshMicros += micros() - start;
+   return true;
 }
 
 
@@ -256,17 +832,7 @@ bool Framebuffer::colorHasSameComponents(int c1, int c2) {
 }
 
 int Framebuffer::addPixelComponents(int p1, int p2) {
-   int r1 = (p1 & 0xFF0000) >> 16;
-   int g1 = (p1 & 0x00FF00) >> 8;
-   int b1 = (p1 & 0x0000FF);
-   int r2 = (p2 & 0xFF0000) >> 16;
-   int g2 = (p2 & 0x00FF00) >> 8;
-   int b2 = (p2 & 0x0000FF);
-
-   r1 = min(r1 + r2, 255);
-   g1 = min(g1 + g2, 255);
-   b1 = min(b1 + b2, 255);
-   return r1 << 16 | g1 << 8 | b1;
+   return addChannelsSaturating(p1, p2);
 }
 
 int Framebuffer::getPixelBrightness(int pixel) {
@@ -277,31 +843,25 @@ int Framebuffer::getPixelBrightness(int pixel) {
 }
 
 void Framebuffer::fillRect(int x0, int y0, int x1, int y1, int color) {
-   for (int x = x0; x <= x1; x++) {
+   // clip once, then fill by whichever direction runs along the strips
+   x0 = max(x0, 0);
+   y0 = max(y0, 0);
+   x1 = min(x1, FB_VIRTUAL_WIDTH - 1);
+   y1 = min(y1, FB_VIRTUAL_HEIGHT - 1);
+   if (x0 > x1 || y0 > y1) return;
+
+   if (abs(rowStride[y0]) == 1) {
       for (int y = y0; y <= y1; y++) {
-         setGridPixel(x, y, color);
+         fillRowSpan(y, x0, x1, color);
+      }
+   } else {
+      for (int x = x0; x <= x1; x++) {
+         fillColumnSpan(x, y0, y1, color);
       }
    }
 }
 
 void Framebuffer::drawNGram(float cx, float cy, unsigned numSides, float size, float rotate, int color) {
-   unsigned i;
-   int x[12], y[12];
-   if (numSides < 3) {
-      return;
-   }
-   if (numSides > ARRAYSIZE(x)) {
-      numSides = ARRAYSIZE(x);
-   }
-   for (i = 0; i < numSides; i++) {
-      x[i] = cx + size * cos(rotate + i * 2 * M_PI / numSides);
-      y[i] = cy + size * sin(rotate + i * 2 * M_PI / numSides);
-   }
-   for (i = 0; i < numSides; i++) {
-      int n = (i + 1) % numSides;
-      drawGridLine(x[i], y[i], x[n], y[n], color);
-   }
+   rasterNGram(cx * FIXED_ONE, cy * FIXED_ONE, numSides, size * FIXED_ONE,
+               (int32_t)(rotate * (0x10000 / (2 * M_PI))), color);
 }
-
-// void Framebuffer::drawCircle(float cx, float cy, float size, int color) {
-// }
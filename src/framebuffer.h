@@ -7,18 +7,33 @@ public:
 
    void setGridPixel(int x, int y, int color);
    int getGridPixel(int x, int y);
+   void blendGridPixel(int x, int y, int color, int alpha); // alpha 0 - 256
    void drawGridLine(int x0, int y0, int x1, int y1, int color);
+   void fillColumnSpan(int x, int y0, int y1, int color); // clipped
+   void fillRowSpan(int y, int x0, int x1, int color);    // clipped
 
+   int toFixedScale(float scale); // 0.0 - 1.0 to 0 - 256
    int scalePixel(int pixel, float scale);
+   int scalePixelFixed(int pixel, int scale);
    float remap(float value, float from1, float from2, float to1, float to2);
 
    void clearScreen();
    void fillScreen(int color);
    void fadeScreenByStep(int fade, int base);
    void fadeScreenByScale(float scale);
+   void fadeScreenByFixedScale(int scale);
 
+   // show() and showWithLimit() encode the frame and hand it to the LEDs
+   // without waiting for the previous one to finish going out; if it hasn't,
+   // the new frame waits until present() finds the LEDs free.
    void showWithLimit();
    void show();
+   void present();      // call often: sends a waiting frame once LEDs are free
+   bool transmitting(); // LEDs still taking the last frame
+   bool framePending(); // a shown frame is waiting for them
+   bool refresh(); // resend the last frame to dither it; false if LEDs busy,
+                   // or if it's all whole output levels (nothing to dither)
+   void setDither(bool on); // if FB_DITHER; off saves the refreshes' time
 
    int randomColor(int componentLimit = 0xFF);
    int randomPrimary(int componentLimit = 0xFF);
@@ -34,6 +49,20 @@ public:
    int height;
    int ledsPerStrip;
    int numPixels;
+   int transmitMicros; // how long it takes to send the LEDs a frame
+   int frameMilliamps; // estimated supply current of the last frame shown
+
+   // output statistics, to measure what skipping unchanged output saves
+   void resetStats();
+   unsigned long framesSent;
+   unsigned long framesSkipped; // show() with nothing changed since last
+   unsigned long framesDropped; // replaced by a newer one before going out
+   unsigned long rowsEncoded;   // ledsPerStrip per full frame
+   unsigned long refreshes;     // dither refreshes between frames
+   unsigned long refreshMicros; // total time encoding them
+
+private:
+   void send();
 };
 
 
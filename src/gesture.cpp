@@ -0,0 +1,49 @@
+#include <Arduino.h>
+#include "defs.h"
+#include "gesture.h"
+
+
+void GestureRecognizer::begin(bool tapTempo) {
+   this->tapTempo = tapTempo;
+   down = false;
+   held = false;
+   clicks = 0;
+   lastPress = 0;
+}
+
+
+bool GestureRecognizer::onChange(bool pressed, long time, Gesture *gesture) {
+   down = pressed;
+   if (!pressed) {
+      return false;
+   }
+
+   held = false;
+   gesture->time = time;
+   if (tapTempo) {
+      gesture->type = GESTURE_TAP;
+   } else {
+      bool quick = clicks && time - lastPress <= multiClickLength;
+      clicks = quick && clicks < 3 ? clicks + 1 : 1;
+      static const GestureType byClicks[] = {
+         GESTURE_CLICK, GESTURE_DOUBLE_CLICK, GESTURE_TRIPLE_CLICK
+      };
+      gesture->type = byClicks[clicks - 1];
+   }
+   lastPress = time;
+   return true;
+}
+
+
+bool GestureRecognizer::poll(long now, Gesture *gesture) {
+   if (!down || held || now - lastPress < holdLength) {
+      return false;
+   }
+
+   // a hold isn't the start of a multi-click
+   held = true;
+   clicks = 0;
+   gesture->type = GESTURE_HOLD;
+   gesture->time = lastPress + holdLength;
+   return true;
+}
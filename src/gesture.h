@@ -0,0 +1,47 @@
+/*
+ * gesture.h
+ *
+ * Turns one button's press and release times into gestures, with the same
+ * thresholds for every button and routine.
+ *
+ * Clicks are sent on the press, without waiting to see whether another
+ * follows, so a double-click arrives as a CLICK and then a DOUBLE_CLICK
+ * (and a triple as all three); anything that treats them differently undoes
+ * what the CLICK did. A fourth quick press starts over with a CLICK. HOLD
+ * comes once, while the button is still down; the press that started it has
+ * already been sent as a click.
+ */
+
+#pragma once
+
+typedef enum {
+   GESTURE_CLICK,
+   GESTURE_DOUBLE_CLICK,
+   GESTURE_TRIPLE_CLICK,
+   GESTURE_HOLD,
+   GESTURE_TAP,   // every press, from a tap-tempo button (instead of clicks)
+} GestureType;
+
+typedef struct {
+   GestureType type;
+   long time;     // millis() of the press (for HOLD, when it became one)
+} Gesture;
+
+
+class GestureRecognizer {
+public:
+   static const long multiClickLength = 300; // ms from one press to the next
+   static const long holdLength = 750;       // ms down
+
+   void begin(bool tapTempo);
+
+   // Feed button changes in; each returns true if it completed a gesture.
+   bool onChange(bool pressed, long time, Gesture *gesture);
+   bool poll(long now, Gesture *gesture); // for HOLD; call often
+
+   bool tapTempo;
+   bool down;
+   bool held;
+   int clicks;     // in the current run
+   long lastPress;
+};
@@ -31,31 +31,34 @@ void ImageRoutine::adjustParam(int step) {
    if (!data->whichImage) {
       data->sparkle = !data->sparkle;
    }
+}
 
-   // double-click toggles randomize
-   int now = millis();
-   int delta = now - data->lastClick;
-   if (delta > 150 && delta < 500) {
+void ImageRoutine::onGesture(GestureType gesture, int step) {
+   // every click changes the image; double-click also toggles randomize
+   if (gesture == GESTURE_DOUBLE_CLICK) {
       data->randomizeOnBeat = !data->randomizeOnBeat;
    }
-   data->lastClick = now;
+   if (gesture != GESTURE_HOLD) {
+      adjustParam(step);
+   }
 }
 
 void ImageRoutine::drawOnBeatSync(FrameTimingInfo *frameTiming) {
    if (data->randomizeOnBeat && data->beatStep == 0) {
       data->whichImage = random(data->numImages);
-      data->throbStep = 0;
+      data->throbPhase = 0;
    }
    data->beatStep = (data->beatStep + 1) % 4;
 }
 
 void ImageRoutine::drawOnFrameSync(FrameTimingInfo *frameTiming) {
-   int numThrobSteps = frameTiming->beatLength * 4 / frameTiming->frameLength;
-   int center = numThrobSteps / 2;
-   int dist = abs(center - data->throbStep);
+   // one throb per measure
+   data->throbPhase = (data->throbPhase + data->throbTimer.perBeat(frameTiming, 0x10000 / 4)) & 0xFFFF;
+   int center = 0x8000;
+   int dist = abs(center - (int)data->throbPhase);
    float scale = (center - dist) * 1.0 / center;
    scale = scale * scale * scale; // decay faster
-   data->throbStep = (data->throbStep + 1) % numThrobSteps;
+   int fixedScale = fb.toFixedScale(scale);
 
    const ImageInfo *image = data->images + data->whichImage;
 
@@ -69,7 +72,7 @@ void ImageRoutine::drawOnFrameSync(FrameTimingInfo *frameTiming) {
          int pixel = r << 16 | g << 8 | b;
 
          // fade pixel
-         pixel = fb.scalePixel(pixel, scale);
+         pixel = fb.scalePixelFixed(pixel, fixedScale);
 
          // we have origin at bottom left; bitmaps have origin at top left
          // so flip vertically
@@ -78,12 +81,17 @@ void ImageRoutine::drawOnFrameSync(FrameTimingInfo *frameTiming) {
    }
 
    fb.showWithLimit();
-   data->frameSparkled = false;
+
+   // the redraw wipes the sparkles, so they go on between frames, but at
+   // the routine pace however fast the frames come; the timer counts here,
+   // where elapsed is since the previous frame
+   int steps = data->sparkleTimer.steps(frameTiming, ROUTINE_STEP_MICROS);
+   data->sparkleSteps = data->sparkle ? data->sparkleSteps + steps : 0;
 }
 
 bool ImageRoutine::drawBetweenFrames(FrameTimingInfo *frameTiming) {
-   if (data->sparkle && !data->frameSparkled) {
-      int numToSparkle = fb.width * fb.height / 10;
+   if (data->sparkle && data->sparkleSteps) {
+      int numToSparkle = fb.width * fb.height / 10 * data->sparkleEffects / 256 * data->sparkleSteps;
       for (int i = 0; i < numToSparkle; i++) {
          int x = random(fb.width);
          int y = random(fb.height);
@@ -92,7 +100,7 @@ bool ImageRoutine::drawBetweenFrames(FrameTimingInfo *frameTiming) {
          pixel = fb.randomPrimaryOrSecondary(limit);
          fb.setGridPixel(x, y, pixel);
       }
-      data->frameSparkled = true;
+      data->sparkleSteps = 0;
       fb.showWithLimit();
       return true;
    }
@@ -100,6 +108,10 @@ bool ImageRoutine::drawBetweenFrames(FrameTimingInfo *frameTiming) {
    return false;
 }
 
+void ImageRoutine::setQuality(const QualityInfo *quality) {
+   data->sparkleEffects = quality->effects;
+}
+
 
 
 void ThemeImageRoutine::begin(void *stateBuf) {
@@ -9,22 +9,26 @@ typedef struct {
 class ImageRoutine: public Routine {
 public:
    void begin(void *stateBuf);
+   void onGesture(GestureType gesture, int step);
    void adjustParam(int step);
    void drawOnBeatSync(FrameTimingInfo *frameTiming);
    void drawOnFrameSync(FrameTimingInfo *frameTiming);
    bool drawBetweenFrames(FrameTimingInfo *frameTiming);
+   void setQuality(const QualityInfo *quality);
 
    typedef struct {
       const ImageInfo *images;
       int numImages;
 
-      int throbStep;
+      uint32_t throbPhase; // through a measure (4 beats), 0 - 65535
+      RateTimer throbTimer;
       int whichImage;
       bool sparkle;
-      bool frameSparkled;
+      int sparkleEffects; // of 256
+      StepTimer sparkleTimer;
+      int sparkleSteps; // due as of the last frame, sparkled between frames
       bool randomizeOnBeat;
       int beatStep;
-      int lastClick;
    } Data;
    Data *data;
 };
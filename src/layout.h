@@ -0,0 +1,134 @@
+/*
+ * layout.h
+ *
+ * Declarative description of how the virtual grid is wired onto the LED
+ * strips, and compile-time helpers to turn that into a lookup table.
+ *
+ * The wiring is described in terms of "segments": straight vertical runs of
+ * LEDs. Each strip is one or more segments laid side by side, so the wiring
+ * grid is (8 * segmentsPerStrip) columns by segmentLength rows. The virtual
+ * grid routines draw on is that wiring grid, optionally mirrored and rotated.
+ */
+
+#pragma once
+
+#include <stdint.h>
+
+struct FbLayout {
+   int stripLength;          // LEDs per strip, including unused ones
+   int segmentLength;        // LEDs in each straight run
+   int segmentsPerStrip;     // runs per strip (adjacent columns)
+   int leadIn;               // unused LEDs at the start of each strip
+   int segmentGap;           // unused LEDs between runs
+   bool firstSegmentUp;      // first run on each strip starts at the bottom
+   bool serpentine;          // each run reverses direction from the previous
+   bool segmentsRightToLeft; // a strip's runs go right to left
+   bool mirrorX;
+   bool mirrorY;
+   int rotation;             // quarter turns from wiring grid to virtual grid
+};
+
+static const int FB_LAYOUT_NUM_STRIPS = 8; // OctoWS2811 drives 8 at a time
+
+
+/*
+ * Geometry. These are all constexpr so they can build the table below; that
+ * means C++11 one-expression style.
+ */
+
+constexpr int layoutWiringWidth(const FbLayout &l) {
+   return FB_LAYOUT_NUM_STRIPS * l.segmentsPerStrip;
+}
+
+constexpr int layoutWiringHeight(const FbLayout &l) {
+   return l.segmentLength;
+}
+
+constexpr int layoutWidth(const FbLayout &l) {
+   return (l.rotation & 1) ? layoutWiringHeight(l) : layoutWiringWidth(l);
+}
+
+constexpr int layoutHeight(const FbLayout &l) {
+   return (l.rotation & 1) ? layoutWiringWidth(l) : layoutWiringHeight(l);
+}
+
+constexpr bool layoutFitsStrip(const FbLayout &l) {
+   return l.leadIn + l.segmentsPerStrip * l.segmentLength
+        + (l.segmentsPerStrip - 1) * l.segmentGap <= l.stripLength;
+}
+
+// LED index of wiring grid column wx, row wy
+constexpr int layoutSegmentOffset(const FbLayout &l, int k, int wy) {
+   return l.leadIn + k * (l.segmentLength + l.segmentGap)
+        + ((l.firstSegmentUp != (l.serpentine && (k & 1))) ? wy : l.segmentLength - 1 - wy);
+}
+
+constexpr int layoutWiringIndex(const FbLayout &l, int wx, int wy) {
+   return (wx / l.segmentsPerStrip) * l.stripLength
+        + layoutSegmentOffset(l, l.segmentsRightToLeft ? l.segmentsPerStrip - 1 - wx % l.segmentsPerStrip
+                                                       : wx % l.segmentsPerStrip, wy);
+}
+
+// LED index of virtual (already mirrored) x, y
+constexpr int layoutRotatedIndex(const FbLayout &l, int x, int y) {
+   return (l.rotation & 3) == 0 ? layoutWiringIndex(l, x, y)
+        : (l.rotation & 3) == 1 ? layoutWiringIndex(l, y, layoutWidth(l) - 1 - x)
+        : (l.rotation & 3) == 2 ? layoutWiringIndex(l, layoutWidth(l) - 1 - x, layoutHeight(l) - 1 - y)
+        :                         layoutWiringIndex(l, layoutHeight(l) - 1 - y, x);
+}
+
+// LED index of virtual grid x, y
+constexpr int layoutLedIndex(const FbLayout &l, int x, int y) {
+   return layoutRotatedIndex(l, l.mirrorX ? layoutWidth(l) - 1 - x : x,
+                                l.mirrorY ? layoutHeight(l) - 1 - y : y);
+}
+
+// Whether cells (x, y0) .. (x, y0 + n - 1) all sit at (x, 0) + y * stride;
+// split in halves to keep the constexpr recursion shallow.
+constexpr bool layoutColumnFollows(const FbLayout &l, int x, int y0, int n, int stride) {
+   return n == 1 ? layoutLedIndex(l, x, y0) == layoutLedIndex(l, x, 0) + y0 * stride
+        : layoutColumnFollows(l, x, y0, n / 2, stride)
+          && layoutColumnFollows(l, x, y0 + n / 2, n - n / 2, stride);
+}
+
+constexpr bool layoutRowFollows(const FbLayout &l, int y, int x0, int n, int stride) {
+   return n == 1 ? layoutLedIndex(l, x0, y) == layoutLedIndex(l, 0, y) + x0 * stride
+        : layoutRowFollows(l, y, x0, n / 2, stride)
+          && layoutRowFollows(l, y, x0 + n / 2, n - n / 2, stride);
+}
+
+// LED index step between vertically adjacent cells in column x, or 0 if
+// the column isn't evenly spaced in LED order.
+constexpr int layoutColumnStride(const FbLayout &l, int x) {
+   return layoutHeight(l) < 2 ? 1
+        : layoutColumnFollows(l, x, 0, layoutHeight(l), layoutLedIndex(l, x, 1) - layoutLedIndex(l, x, 0))
+          ? layoutLedIndex(l, x, 1) - layoutLedIndex(l, x, 0) : 0;
+}
+
+// Likewise for horizontally adjacent cells in row y.
+constexpr int layoutRowStride(const FbLayout &l, int y) {
+   return layoutWidth(l) < 2 ? 1
+        : layoutRowFollows(l, y, 0, layoutWidth(l), layoutLedIndex(l, 1, y) - layoutLedIndex(l, 0, y))
+          ? layoutLedIndex(l, 1, y) - layoutLedIndex(l, 0, y) : 0;
+}
+
+
+/*
+ * Compile-time integer sequences, to expand layoutLedIndex over every grid
+ * cell in an array initializer. Built by halves so big grids don't hit the
+ * template recursion limit.
+ */
+
+template<int... I> struct IndexList {};
+
+template<class A, class B> struct ConcatIndexList;
+template<int... A, int... B> struct ConcatIndexList<IndexList<A...>, IndexList<B...> > {
+   typedef IndexList<A..., (int(sizeof...(A)) + B)...> Type;
+};
+
+template<int N> struct MakeIndexList {
+   typedef typename ConcatIndexList<typename MakeIndexList<N / 2>::Type,
+                                    typename MakeIndexList<N - N / 2>::Type>::Type Type;
+};
+template<> struct MakeIndexList<0> { typedef IndexList<> Type; };
+template<> struct MakeIndexList<1> { typedef IndexList<0> Type; };
@@ -12,6 +12,8 @@
 #include "framebuffer.h"
 #include "control_pad.h"
 #include "platform.h"
+#include "profile.h"
+#include "audio.h"
 
 
 /*
@@ -21,6 +23,9 @@
 Framebuffer fb;
 ControlPad controls;
 Scene scene;
+Profiler profiler;
+AdcAudioSource adcAudio;
+AudioInput audio;
 
 
 void setup() {
@@ -35,6 +40,12 @@ void setup() {
    controls.begin(CONTROL_MAJMODE_PREV_PIN, CONTROL_MAJMODE_NEXT_PIN,
                   CONTROL_MINMODE_PREV_PIN, CONTROL_MINMODE_NEXT_PIN,
                   CONTROL_SPEED_PIN, CONTROL_NEEDS_PULLUP);
+   if (AUDIO_INPUT_PIN) {
+      adcAudio.begin(AUDIO_INPUT_PIN);
+      audio.begin(&adcAudio);
+   } else {
+      audio.begin(NULL);
+   }
    scene.begin();
 }
 
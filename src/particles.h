@@ -0,0 +1,126 @@
+/*
+ * particles.h
+ *
+ * Lots of little things that each move in a straight line and fade: drips,
+ * sparks, snow. Each property is its own array (x of every particle, then
+ * y of every particle...), so the update and render kernels run straight
+ * down the arrays with nothing else in the way; free slots are linked in a
+ * list, so adding one doesn't search for a gap.
+ *
+ * The capacity is a template parameter: a few dozen fit in a routine's
+ * state buffer, and a routine for a bigger canvas can keep thousands in a
+ * static one. Positions and velocities are 24.8 fixed point (see raster.h),
+ * velocities per step; the routine decides how often to step.
+ */
+
+#pragma once
+
+#include <stdint.h>
+#include "framebuffer.h"
+#include "raster.h"
+
+extern Framebuffer fb;
+
+
+template<int capacity> class ParticleSystem {
+public:
+   static const uint16_t none = 0xFFFF;
+   static const int fullLevel = 256;
+
+   // everything dead; the arrays may start out as anything
+   void begin() {
+      for (int i = 0; i < capacity; i++) {
+         level[i] = 0;
+         next[i] = i + 1 < capacity ? i + 1 : none;
+      }
+      freeHead = 0;
+      count = 0;
+   }
+
+   // The new particle's index, or -1 if there's no room. decay is what its
+   // brightness is multiplied by each step, of 256: 256 never fades.
+   int add(fixed x, fixed y, fixed vx, fixed vy, int color, int decay = 256) {
+      if (freeHead == none) {
+         return -1;
+      }
+      int i = freeHead;
+      freeHead = next[i];
+      this->x[i] = x;
+      this->y[i] = y;
+      this->vx[i] = vx;
+      this->vy[i] = vy;
+      this->color[i] = color;
+      this->decay[i] = decay;
+      level[i] = fullLevel;
+      count++;
+      return i;
+   }
+
+   void remove(int i) {
+      level[i] = 0;
+      next[i] = freeHead;
+      freeHead = i;
+      count--;
+   }
+
+   bool isAlive(int i) {
+      return level[i] != 0;
+   }
+
+   // Move everything a step, and fade it; particles that fade out, or get
+   // more than margin pixels off the canvas, are gone.
+   void update(int margin = 0) {
+      fixed minX = toFixed(-margin), maxX = toFixed(fb.width + margin);
+      fixed minY = toFixed(-margin), maxY = toFixed(fb.height + margin);
+      for (int i = 0; i < capacity; i++) {
+         if (!level[i]) continue;
+
+         x[i] += vx[i];
+         y[i] += vy[i];
+         level[i] = level[i] * decay[i] >> 8;
+         if (!level[i] || x[i] < minX || x[i] >= maxX || y[i] < minY || y[i] >= maxY) {
+            remove(i);
+         }
+      }
+   }
+
+   // a pixel for each
+   void render() {
+      for (int i = 0; i < capacity; i++) {
+         if (!level[i]) continue;
+         fb.setGridPixel(x[i] >> FIXED_SHIFT, y[i] >> FIXED_SHIFT,
+                         fb.scalePixelFixed(color[i], level[i]));
+      }
+   }
+
+   // Each with a tail of length pixels back along its velocity, dimming by
+   // fade (of 256) per pixel, and the pixel past the end blacked out: with
+   // a pixel a step, that erases what the previous step drew there.
+   void renderTrails(int length, int fade) {
+      for (int i = 0; i < capacity; i++) {
+         if (!level[i]) continue;
+
+         int brightness = level[i] << 8;
+         fixed px = x[i], py = y[i];
+         for (int n = 0; n < length; n++) {
+            fb.setGridPixel(px >> FIXED_SHIFT, py >> FIXED_SHIFT,
+                            fb.scalePixelFixed(color[i], brightness >> 8));
+            brightness = brightness * fade >> 8;
+            px -= vx[i];
+            py -= vy[i];
+         }
+         fb.setGridPixel(px >> FIXED_SHIFT, py >> FIXED_SHIFT, 0);
+      }
+   }
+
+   fixed x[capacity];
+   fixed y[capacity];
+   fixed vx[capacity];
+   fixed vy[capacity];
+   int color[capacity];
+   uint16_t level[capacity]; // brightness, of fullLevel; 0 is a free slot
+   uint16_t decay[capacity];
+   uint16_t next[capacity];  // free list
+   uint16_t freeHead;
+   int count;
+};
@@ -12,12 +12,11 @@
 #include "framebuffer.h"
 
 extern Framebuffer fb;
-extern OctoWS2811 leds;
 
 //OctoWS2811 Defn. Stuff
 // #define COLS_LEDs 16  // all of the following params need to be adjusted for screen size
 // #define ROWS_LEDs 16  // LED_LAYOUT assumed 0 if ROWS_LEDs > 8
-//We now get this from framebuffer.h, still with same assumption about LED_LAYOUT
+//We now get this from framebuffer.h, and the LED layout from FB_LAYOUT via setGridPixel
 
 
 //Byte val 2PI Cosine Wave, offset by 1 PI 
@@ -36,48 +35,46 @@ uint8_t const cos_wave[256] PROGMEM = {
 };
 
 
-//Gamma Correction Curve
-uint8_t const exp_gamma[256] PROGMEM = {
-   0,0,0,0,0,0,0,0,0,0,0,0,1,1,1,1,1,1,1,1,1,1,1,1,1,1,1,1,1,1,1,2,2,2,2,2,2,2,2,2,3,3,3,3,3,
-   4,4,4,4,4,5,5,5,5,5,6,6,6,7,7,7,7,8,8,8,9,9,9,10,10,10,11,11,12,12,12,13,13,14,14,14,15,15,
-   16,16,17,17,18,18,19,19,20,20,21,21,22,23,23,24,24,25,26,26,27,28,28,29,30,30,31,32,32,33,
-   34,35,35,36,37,38,39,39,40,41,42,43,44,44,45,46,47,48,49,50,51,52,53,54,55,56,57,58,59,60,
-   61,62,63,64,65,66,67,68,70,71,72,73,74,75,77,78,79,80,82,83,84,85,87,89,91,92,93,95,96,98,
-   99,100,101,102,105,106,108,109,111,112,114,115,117,118,120,121,123,125,126,128,130,131,133,
-   135,136,138,140,142,143,145,147,149,151,152,154,156,158,160,162,164,165,167,169,171,173,175,
-   177,179,181,183,185,187,190,192,194,196,198,200,202,204,207,209,211,213,216,218,220,222,225,
-   227,229,232,234,236,239,241,244,246,249,251,253,254,255
-};
-
-
-inline uint8_t fastCosineCalc( uint16_t preWrapVal) {
-   uint8_t wrapVal = (preWrapVal % 255);
-   if (wrapVal<0) wrapVal=255+wrapVal;
-   return (pgm_read_byte_near(cos_wave+wrapVal)); 
+// The table is a full turn in 256 entries, so wrapping is just the low byte.
+inline uint8_t fastCosineCalc(uint16_t preWrapVal) {
+   return pgm_read_byte_near(cos_wave + (preWrapVal & 0xFF));
 }
 
 
 void PlasmaRoutine::begin(void *stateBuf) {
+   static_assert(sizeof(Data) < ROUTINE_STATEBUF_SIZE, "buffer overflow");
    data = (Data *) stateBuf;
    memset(data, 0, sizeof *data);
 
-   data->frameCount = 25500;  // arbitrary seed to calculate the three time displacement variables t,t2,t3
+   // 8 per pixel (a wave every 32) is what it was tuned at; bigger canvases
+   // get smaller steps, so the waves stay about the same size on them
+   data->scale = constrain(256 / max(fb.width, fb.height), 1, 8);
+}
+
+void PlasmaRoutine::onGesture(GestureType gesture, int step) {
+   switch (gesture) {
+      case GESTURE_CLICK:
+         adjustParam(step);
+         break;
+      case GESTURE_DOUBLE_CLICK:
+         // next family, and undo the click's brightness
+         data->family = (data->family + step + NUM_FAMILIES) % NUM_FAMILIES;
+         adjustParam(-step);
+         break;
+      default:
+         break;
+   }
 }
 
 void PlasmaRoutine::adjustParam(int step) {
    data->step = (data->step + step + 3) % 3;
    switch (data->step) {
-      case 0: data->maxAllowedBright = 0; break;  // never bright
-      case 1: data->maxAllowedBright = 50; break; // bright for 50 cycles on beat
-      case 2: data->maxAllowedBright = -1; break; // always bright
+      case 0: data->brightMillis = 0; break;   // never bright
+      case 1: data->brightMillis = 200; break; // bright for the start of each beat
+      case 2: data->brightMillis = -1; break;  // always bright
    }
 }
 
-void PlasmaRoutine::drawOnBeatSync(FrameTimingInfo *frameTiming) {
-   // Pulse brightness on beat
-   data->allowedBright = data->maxAllowedBright;
-}
-
 void PlasmaRoutine::drawOnFrameSync(FrameTimingInfo *frameTiming) {
    // This routine just draws as fast as it can in the between-frames routine,
    // and has no concept of distinct screens.
@@ -85,40 +82,116 @@ void PlasmaRoutine::drawOnFrameSync(FrameTimingInfo *frameTiming) {
 
 bool PlasmaRoutine::drawBetweenFrames(FrameTimingInfo *frameTiming)
 {
-   data->frameCount++;
-
-   uint16_t t = fastCosineCalc((42 * data->frameCount)/100);  //time displacement - fiddle with these til it looks good...
-   uint16_t t2 = fastCosineCalc((35 * data->frameCount)/100); 
-   uint16_t t3 = fastCosineCalc((38 * data->frameCount)/100);
-
-   for (uint8_t y = 0; y < fb.height; y++) {
-      int left2Right, pixelIndex;
-      if (((y % (fb.height/8)) & 1) == 0) {
-         left2Right = 1;
-         pixelIndex = y * fb.width;
-      } else {
-         left2Right = -1;
-         pixelIndex = (y + 1) * fb.width - 1;
+   // stay one frame ahead of the LEDs, no more
+   if (fb.framePending()) {
+      return false;
+   }
+
+   // the animation was tuned at ~30 fps; keep that speed however fast we draw
+   unsigned long frameCount = 25500 + frameTiming->time * 30 / 1000;  // arbitrary seed to calculate the three time displacement variables t,t2,t3
+
+   uint16_t t = fastCosineCalc((42 * frameCount)/100);  //time displacement - fiddle with these til it looks good...
+   uint16_t t2 = fastCosineCalc((35 * frameCount)/100); 
+   uint16_t t3 = fastCosineCalc((38 * frameCount)/100);
+
+   // at lower quality, one pixel stands for a block of them; and on
+   // canvases wider than the column tables, bigger blocks
+   int res = data->resolution;
+   while ((fb.width + res - 1) / res > maxColumns) {
+      res++;
+   }
+   int k = data->scale;
+   int cols = (fb.width + res - 1) / res;
+
+   // the terms that only depend on the column
+   for (int col = 0; col < cols; col++) {
+      int x = col * res;
+      switch (data->family) {
+         case FAMILY_CLASSIC:
+            data->colA[col] = (x * k) + (t >> 1);
+            data->colB[col] = fastCosineCalc((t3 >> 2) + (x * k));
+            data->colC[col] = t + x * k / 8;
+            break;
+         case FAMILY_RINGS: {
+            // distance squared from a center that drifts across the middle
+            int dx = x - fb.width / 2 - ((t - 128) * fb.width >> 9);
+            data->colA[col] = dx * dx * k / 8;
+            break;
+         }
+         case FAMILY_WAVES:
+            data->colA[col] = fastCosineCalc(x * k + t) >> 1;
+            data->colB[col] = x * k / 2;
+            break;
       }
-      for (uint8_t x = 0; x < fb.width ; x++) {
+   }
+
+   for (int y = 0; y < fb.height; y += res) {
+      // and the row
+      uint8_t rowA, rowB, rowC;
+      switch (data->family) {
+         case FAMILY_CLASSIC:
+            rowA = fastCosineCalc(t2 + (y * k));
+            rowB = (y * k) + t;
+            rowC = (y * k) + t2;
+            break;
+         case FAMILY_RINGS: {
+            int dy = y - fb.height / 2 - ((t2 - 128) * fb.height >> 9);
+            rowA = dy * dy * k / 8;
+            rowB = rowC = 0;
+            break;
+         }
+         default:
+            rowA = fastCosineCalc(y * k + t2) >> 1;
+            rowB = y * k / 2 + t3;
+            rowC = 0;
+            break;
+      }
+
+      for (int col = 0; col < cols; col++) {
          //Calculate 3 separate plasma waves, one for each color channel
-         uint8_t r = fastCosineCalc(((x << 3) + (t >> 1) + fastCosineCalc((t2 + (y << 3)))));
-         uint8_t g = fastCosineCalc(((y << 3) + t + fastCosineCalc(((t3 >> 2) + (x << 3)))));
-         uint8_t b = fastCosineCalc(((y << 3) + t2 + fastCosineCalc((t + x + (g >> 2)))));
-         //uncomment the following to enable gamma correction
-         //r=pgm_read_byte_near(exp_gamma+r);  
-         //g=pgm_read_byte_near(exp_gamma+g);
-         //b=pgm_read_byte_near(exp_gamma+b);
-         leds.setPixel(pixelIndex, ((r << 16) | (g << 8) | b));
-         pixelIndex += left2Right;
+         uint8_t r, g, b;
+         switch (data->family) {
+            case FAMILY_CLASSIC:
+               r = fastCosineCalc(data->colA[col] + rowA);
+               g = fastCosineCalc(rowB + data->colB[col]);
+               b = fastCosineCalc(rowC + fastCosineCalc(data->colC[col] + (g >> 2)));
+               break;
+            case FAMILY_RINGS: {
+               uint8_t d = data->colA[col] + rowA;
+               r = fastCosineCalc(d + t);
+               g = fastCosineCalc(d + t2 + 85);
+               b = fastCosineCalc(2 * d + t3);
+               break;
+            }
+            default: {
+               // the two straight waves, and a diagonal one between them
+               uint8_t v = data->colA[col] + rowA + (fastCosineCalc(data->colB[col] + rowB) >> 1);
+               r = fastCosineCalc(v);
+               g = fastCosineCalc(v + 85);
+               b = fastCosineCalc(v + 170);
+               break;
+            }
+         }
+
+         int color = (r << 16) | (g << 8) | b;
+         int x = col * res;
+         if (res == 1) {
+            fb.setGridPixel(x, y, color);
+         } else {
+            fb.fillRect(x, y, x + res - 1, y + res - 1, color);
+         }
       }
    }
 
-   if (data->allowedBright) {
-      data->allowedBright--;
+   // the pulse is timed from the beat, so it lasts as long at any frame rate
+   if (data->brightMillis < 0 || frameTiming->beatRelative < data->brightMillis) {
       fb.show();
    } else {
       fb.showWithLimit();
    }
    return true;
 }
+
+void PlasmaRoutine::setQuality(const QualityInfo *quality) {
+   data->resolution = quality->resolution;
+}
@@ -6,6 +6,9 @@
 
 #pragma once
 
+#include "layout.h"
+#include "power.h"
+
 // Framebuffer "physical" layout is the LED layout: the way it's actually wired
 // (physical width is the number of strips, probably 8;
 // physical height is the number of LEDs in the longest strip)
@@ -21,6 +24,43 @@ static const int FB_VIRTUAL_HEIGHT = 16;
 static const bool FB_MIRROR_X = false;
 static const bool FB_MIRROR_Y = false;
 
+// How the virtual grid is wired (see layout.h): each 32-LED strip runs up
+// one column and back down the column to its left.
+static constexpr FbLayout FB_LAYOUT = {
+   FB_PHYSICAL_HEIGHT, // stripLength
+   16,                 // segmentLength
+   2,                  // segmentsPerStrip
+   0,                  // leadIn
+   0,                  // segmentGap
+   true,               // firstSegmentUp
+   true,               // serpentine
+   true,               // segmentsRightToLeft
+   FB_MIRROR_X,
+   FB_MIRROR_Y,
+   0,                  // rotation
+};
+
+// Current model for the brightness limiter (see power.h). Per-unit figures
+// are typical for WS2811 pixels (~16 mA per channel at full on); measure
+// and adjust if the LEDs change.
+static const FbPowerModel FB_POWER = {
+   63,   // redMicroampsPerUnit
+   67,   // greenMicroampsPerUnit
+   63,   // blueMicroampsPerUnit
+   800,  // idleMicroampsPerLed
+   500,  // stripBudgetMilliamps
+   1500, // totalBudgetMilliamps
+};
+
+// Keep the working framebuffer at 16 bits per channel, so slow fades and
+// blends don't stall on 8-bit rounding; costs 4 more bytes of RAM per LED.
+static const bool FB_DEEP_COLOR = true;
+
+// Output gamma (1.0 for none), and whether to dither the result to 8 bits
+// over the refreshes sent between frames.
+static const float FB_GAMMA = 2.2;
+static const bool FB_DITHER = true;
+
 // Pins to use for control-button inputs
 static const int CONTROL_MAJMODE_PREV_PIN = 0;
 static const int CONTROL_MAJMODE_NEXT_PIN = 9;
@@ -29,6 +69,11 @@ static const int CONTROL_MINMODE_NEXT_PIN = 10;
 static const int CONTROL_SPEED_PIN = 11;
 static const bool CONTROL_NEEDS_PULLUP = true;
 
+// Analog pin with a microphone on it (an electret and amplifier, biased to
+// mid-supply, into a free analog input), for the beat to follow the music
+// (see audio.h); 0 for none, and tap tempo only.
+static const int AUDIO_INPUT_PIN = 0;
+
 // See scene.cpp.
 #define Platform_DeclareRoutines \
    USE(DripRoutine)              \
@@ -46,5 +91,7 @@ static const bool CONTROL_NEEDS_PULLUP = true;
    USE(SmileyImageRoutine)       \
    USE(Simon)                    \
    USE(StripeRoutine)            \
+   USE(AutomatonRoutine)         \
    /* end */
 // USE(OrientationRoutine)
+// USE(SpectrumRoutine)             // needs AUDIO_INPUT_PIN
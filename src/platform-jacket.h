@@ -6,6 +6,9 @@
 
 #pragma once
 
+#include "layout.h"
+#include "power.h"
+
 // Framebuffer "physical" layout is the LED layout: the way it's actually wired
 // (physical width is the number of strips, probably 8;
 // physical height is the number of LEDs in the longest strip)
@@ -27,6 +30,43 @@ static const bool FB_MIRROR_X = true;
 #endif
 static const bool FB_MIRROR_Y = false;
 
+// How the virtual grid is wired (see layout.h): each strip is one column,
+// starting at the top.
+static constexpr FbLayout FB_LAYOUT = {
+   FB_PHYSICAL_HEIGHT, // stripLength
+   FB_PHYSICAL_HEIGHT, // segmentLength
+   1,                  // segmentsPerStrip
+   0,                  // leadIn
+   0,                  // segmentGap
+   false,              // firstSegmentUp
+   false,              // serpentine
+   false,              // segmentsRightToLeft
+   FB_MIRROR_X,
+   FB_MIRROR_Y,
+   0,                  // rotation
+};
+
+// Current model for the brightness limiter (see power.h). Per-unit figures
+// are typical for WS2811 pixels (~16 mA per channel at full on); measure
+// and adjust if the LEDs change.
+static const FbPowerModel FB_POWER = {
+   63,   // redMicroampsPerUnit
+   67,   // greenMicroampsPerUnit
+   63,   // blueMicroampsPerUnit
+   800,  // idleMicroampsPerLed
+   400,  // stripBudgetMilliamps
+   1200, // totalBudgetMilliamps
+};
+
+// Keep the working framebuffer at 16 bits per channel, so slow fades and
+// blends don't stall on 8-bit rounding; costs 4 more bytes of RAM per LED.
+static const bool FB_DEEP_COLOR = true;
+
+// Output gamma (1.0 for none), and whether to dither the result to 8 bits
+// over the refreshes sent between frames.
+static const float FB_GAMMA = 2.2;
+static const bool FB_DITHER = true;
+
 // Pins to use for control-button inputs
 static const int CONTROL_MAJMODE_PREV_PIN = 10;
 static const int CONTROL_MAJMODE_NEXT_PIN = 18;
@@ -35,6 +75,11 @@ static const int CONTROL_MINMODE_NEXT_PIN = 17;
 static const int CONTROL_SPEED_PIN = 9;
 static const bool CONTROL_NEEDS_PULLUP = false;
 
+// Analog pin with a microphone on it (an electret and amplifier, biased to
+// mid-supply, into a free analog input), for the beat to follow the music
+// (see audio.h); 0 for none, and tap tempo only.
+static const int AUDIO_INPUT_PIN = 0;
+
 
 // See scene.cpp.
 #define Platform_DeclareRoutines \
@@ -54,4 +99,6 @@ static const bool CONTROL_NEEDS_PULLUP = false;
    // USE(TranslucentSquares)
    // USE(GeoGrow)
    // USE(StripeRoutine)
+   // USE(AutomatonRoutine)
    // USE(OrientationRoutine)
+   // USE(SpectrumRoutine)          // needs AUDIO_INPUT_PIN
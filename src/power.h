@@ -0,0 +1,17 @@
+/*
+ * power.h
+ *
+ * Parameters for the current model used by Framebuffer::showWithLimit to
+ * keep each strip, and the whole supply, within budget.
+ */
+
+#pragma once
+
+struct FbPowerModel {
+   int redMicroampsPerUnit;     // current drawn per step of each channel
+   int greenMicroampsPerUnit;
+   int blueMicroampsPerUnit;
+   int idleMicroampsPerLed;     // drawn by every LED, even when black
+   int stripBudgetMilliamps;    // limit per strip (wiring, connectors)
+   int totalBudgetMilliamps;    // limit for the whole supply
+};
@@ -0,0 +1,137 @@
+#include <Arduino.h>
+#include "defs.h"
+#include "framebuffer.h"
+#include "profile.h"
+#include "telemetry.h"
+
+
+static_assert(sizeof(TelemetryHistogram) <= 255, "histogram record too long");
+static_assert(ARRAYSIZE(((TelemetryHistogram *)0)->buckets) == LatencyHistogram::numBuckets,
+              "histogram record doesn't match LatencyHistogram");
+
+
+void LatencyHistogram::reset() {
+   memset(this, 0, sizeof *this);
+   min = UINT32_MAX;
+}
+
+int LatencyHistogram::bucketOf(uint32_t micros) {
+   if (micros < 4) return micros;
+
+   int log2 = 31 - __builtin_clz(micros);
+   int bucket = (log2 - 1) * 4 + ((micros >> (log2 - 2)) & 3);
+   return bucket < numBuckets ? bucket : numBuckets - 1;
+}
+
+void LatencyHistogram::record(uint32_t micros, uint32_t deadline) {
+   uint16_t *bucket = buckets + bucketOf(micros);
+   if (*bucket < UINT16_MAX) (*bucket)++;
+
+   count++;
+   if (micros < min) min = micros;
+   if (micros > max) max = micros;
+   if (deadline && micros > deadline && misses < UINT16_MAX) misses++;
+}
+
+void LatencyHistogram::recordDropped(uint32_t n) {
+   dropped += n;
+}
+
+
+Profiler::Profiler() {
+   deadlineMicros = 0;
+   qualityLevel = 0;
+   reportInterval = 2000;
+   routine = 0;
+   lastReport = 0;
+   nextToSend = -1;
+   for (int i = 0; i < PROFILE_NUM_CALLBACKS; i++) {
+      histograms[i].reset();
+   }
+}
+
+void Profiler::begin(int routine, const char *name) {
+   // whatever the last routine recorded, then start over
+   for (int i = 0; i < PROFILE_NUM_CALLBACKS; i++) {
+      sendHistogram(i);
+      histograms[i].reset();
+   }
+   sendFbStats();
+   fb.resetStats();
+
+   TelemetryRoutine record;
+   memset(&record, 0, sizeof record);
+   record.index = routine;
+   // the memset above leaves the rest of it zeroed
+   memcpy(record.name, name, strnlen(name, sizeof record.name));
+   telemetrySend(TELEMETRY_ROUTINE, &record, sizeof record);
+
+   this->routine = routine;
+   lastReport = millis();
+   nextToSend = -1;
+}
+
+void Profiler::record(ProfileCallback callback, uint32_t micros) {
+   histograms[callback].record(micros, deadlineMicros);
+}
+
+void Profiler::recordDropped(ProfileCallback callback, uint32_t n) {
+   histograms[callback].recordDropped(n);
+}
+
+void Profiler::flush() {
+#if DEBUG
+   if (nextToSend < 0) {
+      if (millis() - lastReport < reportInterval) return;
+      lastReport = millis();
+      nextToSend = 0;
+   }
+
+   // one record per call, to keep each idle slice short; if the queue is
+   // full, try the same one again next time
+   bool sent = nextToSend < PROFILE_NUM_CALLBACKS ? sendHistogram(nextToSend) : sendFbStats();
+   if (!sent) return;
+
+   nextToSend++;
+   if (nextToSend > PROFILE_NUM_CALLBACKS) {
+      nextToSend = -1;
+   }
+#endif
+}
+
+bool Profiler::sendHistogram(int callback) {
+   LatencyHistogram *h = histograms + callback;
+   if (!h->count && !h->dropped) return true;
+
+   TelemetryHistogram record;
+   record.routine = routine;
+   record.callback = callback;
+   record.misses = h->misses;
+   record.count = h->count;
+   record.min = h->min;
+   record.max = h->max;
+   record.dropped = h->dropped;
+   memcpy(record.buckets, h->buckets, sizeof record.buckets);
+   if (!telemetrySend(TELEMETRY_HISTOGRAM, &record, sizeof record)) return false;
+
+   h->reset();
+   return true;
+}
+
+bool Profiler::sendFbStats() {
+   TelemetryFbStats record;
+   record.time = millis();
+   record.milliamps = fb.frameMilliamps;
+   record.framesSent = fb.framesSent;
+   record.framesSkipped = fb.framesSkipped;
+   record.framesDropped = fb.framesDropped;
+   record.rowsEncoded = fb.rowsEncoded;
+   record.refreshes = fb.refreshes;
+   record.refreshMicros = fb.refreshMicros;
+   record.framePeriod = deadlineMicros; // which the scene keeps at the frame period
+   record.qualityLevel = qualityLevel;
+   if (!telemetrySend(TELEMETRY_FB_STATS, &record, sizeof record)) return false;
+
+   fb.resetStats();
+   return true;
+}
@@ -0,0 +1,83 @@
+/*
+ * profile.h
+ *
+ * Latency histograms for the current routine's callbacks. Recording is a
+ * few instructions; the histograms go out as telemetry records (see
+ * telemetry.h) from idle time, and tools/telemetry.py on the host adds them
+ * up per routine and works out the percentiles.
+ */
+
+#pragma once
+
+#include <stdint.h>
+
+typedef enum {
+   PROFILE_BEAT,   // Routine::drawOnBeatSync
+   PROFILE_FRAME,  // Routine::drawOnFrameSync
+   PROFILE_TWEEN,  // Routine::drawBetweenFrames, when it drew
+   PROFILE_SHOW,   // Framebuffer::show and showWithLimit
+   PROFILE_FRAME_LATE, // how long after its deadline each frame started
+   PROFILE_BEAT_LATE,  // likewise each beat
+   PROFILE_INPUT_LATE, // how long after the button changed each event was handled
+   PROFILE_AUDIO,  // AudioInput::process, when there was a hop to analyze
+   PROFILE_WORK,   // Routine::workBetweenFrames, when there was any
+   PROFILE_NUM_CALLBACKS
+} ProfileCallback;
+
+
+/*
+ * Counts of samples by duration in us: exact below 4, then 4 buckets per
+ * power of 2 (so within 25%), up to the last bucket, which takes everything
+ * from 114.7 ms up.
+ */
+class LatencyHistogram {
+public:
+   static const int numBuckets = 64;
+
+   void reset();
+   void record(uint32_t micros, uint32_t deadline);
+   void recordDropped(uint32_t n);
+
+   static int bucketOf(uint32_t micros);
+
+   uint32_t count;
+   uint32_t min;
+   uint32_t max;
+   uint16_t misses; // samples over the deadline
+   uint32_t dropped; // for the *_LATE ones: deadlines skipped altogether
+   uint16_t buckets[numBuckets];
+};
+
+
+class Profiler {
+public:
+   Profiler();
+
+   // Start profiling routine index, first queueing what's been recorded
+   // for the previous one.
+   void begin(int routine, const char *name);
+   void record(ProfileCallback callback, uint32_t micros);
+   void recordDropped(ProfileCallback callback, uint32_t n);
+
+   // Queue the next record that's due; call in idle time.
+   void flush();
+
+   // what's been recorded since the last report
+   const LatencyHistogram *histogram(ProfileCallback callback) { return histograms + callback; }
+
+   uint32_t deadlineMicros; // samples longer than this count as misses
+   int qualityLevel;        // the scene's, reported with the fb stats
+   uint32_t reportInterval; // ms between reports
+
+private:
+   bool sendHistogram(int callback); // false if no room; resets it if sent
+   bool sendFbStats();               // likewise the framebuffer stats
+
+   int routine;
+   uint32_t lastReport;
+   int nextToSend; // callback, or PROFILE_NUM_CALLBACKS for fb stats; -1 idle
+   LatencyHistogram histograms[PROFILE_NUM_CALLBACKS];
+};
+
+
+extern Profiler profiler;
@@ -0,0 +1,256 @@
+#include <Arduino.h>
+#include "defs.h"
+#include "framebuffer.h"
+#include "raster.h"
+
+
+/*
+ * Trig. One full turn of sine, scaled by 1 << 14, with a repeated first
+ * entry so we can interpolate off the end.
+ */
+static const int16_t sineTable[257] = {
+   0, 402, 804, 1205, 1606, 2006, 2404, 2801, 3196, 3590, 3981, 4370,
+   4756, 5139, 5520, 5897, 6270, 6639, 7005, 7366, 7723, 8076, 8423, 8765,
+   9102, 9434, 9760, 10080, 10394, 10702, 11003, 11297, 11585, 11866, 12140, 12406,
+   12665, 12916, 13160, 13395, 13623, 13842, 14053, 14256, 14449, 14635, 14811, 14978,
+   15137, 15286, 15426, 15557, 15679, 15791, 15893, 15986, 16069, 16143, 16207, 16261,
+   16305, 16340, 16364, 16379, 16384, 16379, 16364, 16340, 16305, 16261, 16207, 16143,
+   16069, 15986, 15893, 15791, 15679, 15557, 15426, 15286, 15137, 14978, 14811, 14635,
+   14449, 14256, 14053, 13842, 13623, 13395, 13160, 12916, 12665, 12406, 12140, 11866,
+   11585, 11297, 11003, 10702, 10394, 10080, 9760, 9434, 9102, 8765, 8423, 8076,
+   7723, 7366, 7005, 6639, 6270, 5897, 5520, 5139, 4756, 4370, 3981, 3590,
+   3196, 2801, 2404, 2006, 1606, 1205, 804, 402, 0, -402, -804, -1205,
+   -1606, -2006, -2404, -2801, -3196, -3590, -3981, -4370, -4756, -5139, -5520, -5897,
+   -6270, -6639, -7005, -7366, -7723, -8076, -8423, -8765, -9102, -9434, -9760, -10080,
+   -10394, -10702, -11003, -11297, -11585, -11866, -12140, -12406, -12665, -12916, -13160, -13395,
+   -13623, -13842, -14053, -14256, -14449, -14635, -14811, -14978, -15137, -15286, -15426, -15557,
+   -15679, -15791, -15893, -15986, -16069, -16143, -16207, -16261, -16305, -16340, -16364, -16379,
+   -16384, -16379, -16364, -16340, -16305, -16261, -16207, -16143, -16069, -15986, -15893, -15791,
+   -15679, -15557, -15426, -15286, -15137, -14978, -14811, -14635, -14449, -14256, -14053, -13842,
+   -13623, -13395, -13160, -12916, -12665, -12406, -12140, -11866, -11585, -11297, -11003, -10702,
+   -10394, -10080, -9760, -9434, -9102, -8765, -8423, -8076, -7723, -7366, -7005, -6639,
+   -6270, -5897, -5520, -5139, -4756, -4370, -3981, -3590, -3196, -2801, -2404, -2006,
+   -1606, -1205, -804, -402, 0,
+};
+
+int fixedSin(uint16_t angle) {
+   int i = angle >> 8;
+   int frac = angle & 0xFF;
+   return sineTable[i] + (((sineTable[i + 1] - sineTable[i]) * frac) >> 8);
+}
+
+int fixedCos(uint16_t angle) {
+   return fixedSin(angle + 0x4000);
+}
+
+uint16_t fixedAtan2(int32_t y, int32_t x) {
+   if (!x && !y) return 0;
+
+   // fold into the first octant, t = tan of the angle there (1 << 15 is 1)
+   uint32_t ax = abs(x), ay = abs(y);
+   bool steep = ay > ax;
+   uint32_t t = steep ? ((uint64_t)ax << 15) / ay : ((uint64_t)ay << 15) / ax;
+
+   // atan(t) ~= pi/4 t + 0.273 t (1 - t), in binary angle (8192 is pi/4)
+   uint32_t angle = (t * 8192 >> 15) + ((2851 * ((t * (32768 - t)) >> 15)) >> 15);
+
+   // and unfold
+   if (steep) angle = 0x4000 - angle;
+   if (x < 0) angle = 0x8000 - angle;
+   if (y < 0) angle = 0x10000 - angle;
+   return angle;
+}
+
+
+static inline int fixedFloor(fixed v) {
+   return v >> FIXED_SHIFT;
+}
+
+static inline int fixedRound(fixed v) {
+   return (v + FIXED_ONE / 2) >> FIXED_SHIFT;
+}
+
+static inline void swapFixed(fixed &a, fixed &b) {
+   fixed t = a; a = b; b = t;
+}
+
+
+/*
+ * Lines: Xiaolin Wu's algorithm. Step one pixel at a time along the major
+ * axis, and split each step's coverage between the two pixels the line
+ * passes between on the minor axis.
+ */
+static inline void plot(bool steep, int major, int minor, int color, int alpha) {
+   if (steep) {
+      fb.blendGridPixel(minor, major, color, alpha);
+   } else {
+      fb.blendGridPixel(major, minor, color, alpha);
+   }
+}
+
+// Plot the two pixels straddling minor (16.16) in column major, with the
+// total coverage scaled by weight/256.
+static inline void plotPair(bool steep, int major, int32_t minor, int color, int weight) {
+   int row = minor >> 16;
+   int frac = (minor >> 8) & 0xFF;
+   plot(steep, major, row, color, (256 - frac) * weight >> 8);
+   plot(steep, major, row + 1, color, frac * weight >> 8);
+}
+
+void rasterLine(fixed x0, fixed y0, fixed x1, fixed y1, int color) {
+   bool steep = abs(y1 - y0) > abs(x1 - x0);
+   if (steep) {
+      swapFixed(x0, y0);
+      swapFixed(x1, y1);
+   }
+   if (x0 > x1) {
+      swapFixed(x0, x1);
+      swapFixed(y0, y1);
+   }
+
+   fixed dx = x1 - x0;
+   fixed dy = y1 - y0;
+   int32_t gradient = dx ? (int32_t)(((int64_t)dy << 16) / dx) : 0; // 16.16
+
+   int xStart = fixedRound(x0);
+   int xEnd = fixedRound(x1);
+   // minor-axis position at the center of column xStart, 16.16
+   int32_t y = (y0 << 8) + (int32_t)(((int64_t)gradient * (toFixed(xStart) - x0)) >> 8);
+
+   if (xStart == xEnd) {
+      plotPair(steep, xStart, y, color, min(dx, FIXED_ONE));
+      return;
+   }
+
+   // endpoints are weighted by how much of their column the line covers
+   plotPair(steep, xStart, y, color, FIXED_ONE - ((x0 + FIXED_ONE / 2) & (FIXED_ONE - 1)));
+   y += gradient;
+   for (int x = xStart + 1; x < xEnd; x++, y += gradient) {
+      plotPair(steep, x, y, color, FIXED_ONE);
+   }
+   plotPair(steep, xEnd, y, color, (x1 + FIXED_ONE / 2) & (FIXED_ONE - 1));
+}
+
+
+/*
+ * Polygons
+ */
+static const int maxPolygonPoints = 16;
+
+void rasterPolygon(const fixed *x, const fixed *y, int numPoints, int color) {
+   for (int i = 0; i < numPoints; i++) {
+      int n = (i + 1) % numPoints;
+      rasterLine(x[i], y[i], x[n], y[n], color);
+   }
+}
+
+void rasterFillPolygon(const fixed *x, const fixed *y, int numPoints, int color) {
+   if (numPoints < 3 || numPoints > maxPolygonPoints) {
+      return;
+   }
+
+   fixed minY = y[0], maxY = y[0];
+   for (int i = 1; i < numPoints; i++) {
+      minY = min(minY, y[i]);
+      maxY = max(maxY, y[i]);
+   }
+   int rowStart = max(fixedFloor(minY + FIXED_ONE - 1), 0);
+   int rowEnd = min(fixedFloor(maxY), fb.height - 1);
+
+   // scan each row through its pixel centers, filling between crossings
+   for (int row = rowStart; row <= rowEnd; row++) {
+      fixed yc = toFixed(row);
+      fixed crossings[maxPolygonPoints];
+      int numCrossings = 0;
+
+      for (int i = 0; i < numPoints; i++) {
+         int n = (i + 1) % numPoints;
+         fixed ya = y[i], yb = y[n];
+         if (ya == yb || yc < min(ya, yb) || yc >= max(ya, yb)) continue;
+
+         fixed xc = x[i] + (fixed)(((int64_t)(yc - ya) * (x[n] - x[i])) / (yb - ya));
+         int j = numCrossings++;
+         for (; j > 0 && crossings[j - 1] > xc; j--) {
+            crossings[j] = crossings[j - 1];
+         }
+         crossings[j] = xc;
+      }
+
+      for (int i = 0; i + 1 < numCrossings; i += 2) {
+         int xa = fixedFloor(crossings[i] + FIXED_ONE - 1);
+         int xb = fixedFloor(crossings[i + 1]);
+         if (xa <= xb) {
+            fb.fillRowSpan(row, xa, xb, color);
+         }
+      }
+   }
+
+   // and smooth the edges
+   rasterPolygon(x, y, numPoints, color);
+}
+
+void rasterNGram(fixed cx, fixed cy, int numSides, fixed size, uint16_t rotate, int color) {
+   fixed x[maxPolygonPoints], y[maxPolygonPoints];
+   if (numSides < 3) {
+      return;
+   }
+   if (numSides > maxPolygonPoints) {
+      numSides = maxPolygonPoints;
+   }
+
+   for (int i = 0; i < numSides; i++) {
+      uint16_t angle = rotate + (uint16_t)(i * 0x10000 / numSides);
+      x[i] = cx + (fixed)(((int64_t)size * fixedCos(angle)) >> 14);
+      y[i] = cy + (fixed)(((int64_t)size * fixedSin(angle)) >> 14);
+   }
+   rasterPolygon(x, y, numSides, color);
+}
+
+
+/*
+ * Circles. A pixel's distance outside the circle, d - r, is approximated by
+ * (d^2 - r^2) / 2r, which is close enough within a pixel of the edge and
+ * saves a square root per pixel.
+ */
+static void rasterCircleCoverage(fixed cx, fixed cy, fixed radius, int color, bool fill) {
+   fixed twoR = max(radius * 2, FIXED_ONE);
+   int64_t r2 = (int64_t)radius * radius;
+
+   int x0 = max(fixedFloor(cx - radius - FIXED_ONE), 0);
+   int x1 = min(fixedFloor(cx + radius + FIXED_ONE) + 1, fb.width - 1);
+   int y0 = max(fixedFloor(cy - radius - FIXED_ONE), 0);
+   int y1 = min(fixedFloor(cy + radius + FIXED_ONE) + 1, fb.height - 1);
+
+   for (int y = y0; y <= y1; y++) {
+      int64_t dy = toFixed(y) - cy;
+      for (int x = x0; x <= x1; x++) {
+         int64_t dx = toFixed(x) - cx;
+         int64_t diff = dx * dx + dy * dy - r2; // 16.16
+         int alpha;
+
+         if (fill) {
+            if (diff <= -(int64_t)twoR * (FIXED_ONE / 2)) {
+               alpha = 256;
+            } else if (diff >= (int64_t)twoR * (FIXED_ONE / 2)) {
+               continue;
+            } else {
+               alpha = FIXED_ONE / 2 - (int)(diff / twoR);
+            }
+         } else {
+            if (diff >= (int64_t)twoR * FIXED_ONE || diff <= -(int64_t)twoR * FIXED_ONE) {
+               continue;
+            }
+            alpha = FIXED_ONE - abs((int)(diff / twoR));
+         }
+         fb.blendGridPixel(x, y, color, alpha);
+      }
+   }
+}
+
+void rasterCircle(fixed cx, fixed cy, fixed radius, int color) {
+   rasterCircleCoverage(cx, cy, radius, color, false);
+}
+
+void rasterFillCircle(fixed cx, fixed cy, fixed radius, int color) {
+   rasterCircleCoverage(cx, cy, radius, color, true);
+}
@@ -0,0 +1,45 @@
+/*
+ * raster.h
+ *
+ * Fixed-point, anti-aliased drawing onto the framebuffer grid.
+ *
+ * Coordinates are 24.8 fixed point ("fixed"), with the center of grid pixel
+ * (x, y) at (x << 8, y << 8), so shapes can sit between pixels and move by
+ * less than a pixel per frame. Angles are 16-bit binary angles: 65536 is a
+ * full turn.
+ */
+
+#pragma once
+
+#include <stdint.h>
+
+typedef int32_t fixed;
+
+static const int FIXED_SHIFT = 8;
+static const fixed FIXED_ONE = 1 << FIXED_SHIFT;
+
+inline fixed toFixed(int i) {
+   return i << FIXED_SHIFT;
+}
+
+// sin and cos, scaled by 1 << 14
+int fixedSin(uint16_t angle);
+int fixedCos(uint16_t angle);
+// the angle of (x, y) from the x axis, counterclockwise, within ~0.25 degree
+uint16_t fixedAtan2(int32_t y, int32_t x);
+
+// Wu-style anti-aliased line between two points.
+void rasterLine(fixed x0, fixed y0, fixed x1, fixed y1, int color);
+
+// Closed polygon through numPoints vertices. Filled polygons are filled at
+// pixel centers, then outlined anti-aliased.
+void rasterPolygon(const fixed *x, const fixed *y, int numPoints, int color);
+void rasterFillPolygon(const fixed *x, const fixed *y, int numPoints, int color);
+
+// Regular numSides-gon centered on cx, cy with the given circumradius, the
+// first vertex at angle rotate.
+void rasterNGram(fixed cx, fixed cy, int numSides, fixed size, uint16_t rotate, int color);
+
+// Circle outline (1 pixel wide) or disc, anti-aliased.
+void rasterCircle(fixed cx, fixed cy, fixed radius, int color);
+void rasterFillCircle(fixed cx, fixed cy, fixed radius, int color);
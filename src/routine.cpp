@@ -2,6 +2,7 @@
 #include "defs.h"
 #include "routine.h"
 #include "framebuffer.h"
+#include "raster.h"
 
 void OrientationRoutine::begin(void *stateBuf) {
    static_assert(sizeof(Data) < ROUTINE_STATEBUF_SIZE, "buffer overflow");
@@ -12,21 +13,24 @@ void OrientationRoutine::begin(void *stateBuf) {
 }
 
 void OrientationRoutine::drawOnFrameSync(FrameTimingInfo *frameTiming) {
-   if (!data->x && !data->y) {
-      data->color = fb.randomColor();
-   }
-
-   fb.setGridPixel(data->oldX, data->oldY, 0);
-   fb.setGridPixel(data->x, data->y, data->color);
-   data->oldX = data->x;
-   data->oldY = data->y;
+   // one pixel per step
+   for (int n = data->stepTimer.steps(frameTiming, ROUTINE_STEP_MICROS); n; n--) {
+      if (!data->x && !data->y) {
+         data->color = fb.randomColor();
+      }
 
-   data->x++;
-   if (data->x >= fb.width) {
-      data->x = 0;
-      data->y++;
-      if (data->y >= fb.height) {
-         data->y = 0;
+      fb.setGridPixel(data->oldX, data->oldY, 0);
+      fb.setGridPixel(data->x, data->y, data->color);
+      data->oldX = data->x;
+      data->oldY = data->y;
+
+      data->x++;
+      if (data->x >= fb.width) {
+         data->x = 0;
+         data->y++;
+         if (data->y >= fb.height) {
+            data->y = 0;
+         }
       }
    }
 
@@ -82,28 +86,31 @@ void StripeRoutine::drawOnFrameSync(FrameTimingInfo *frameTiming) {
          return;
    }
 
-   // erase current stripe
-   if (data->skipErase) {
-      data->skipErase--;
-   } else {
-      fb.drawGridLine(x1, y1, x2, y2, 0);
-   }
+   // one row per step
+   for (int n = data->stepTimer.steps(frameTiming, ROUTINE_STEP_MICROS); n; n--) {
+      // erase current stripe
+      if (data->skipErase) {
+         data->skipErase--;
+      } else {
+         fb.drawGridLine(x1, y1, x2, y2, 0);
+      }
 
-   // advance
-   data->row = (data->row + step + end) % end;
-   switch (data->direction) {
-      case 0:
-      case 2:
-         x1 = 0; x2 = fb.width - 1; y1 = y2 = data->row;
-         break;
-      case 1:
-      case 3:
-         x1 = x2 = data->row; y1 = 0; y2 = fb.height - 1;
-         break;
-   }
+      // advance
+      data->row = (data->row + step + end) % end;
+      switch (data->direction) {
+         case 0:
+         case 2:
+            x1 = 0; x2 = fb.width - 1; y1 = y2 = data->row;
+            break;
+         case 1:
+         case 3:
+            x1 = x2 = data->row; y1 = 0; y2 = fb.height - 1;
+            break;
+      }
 
-   // draw next stripe
-   fb.drawGridLine(x1, y1, x2, y2, data->color);
+      // draw next stripe
+      fb.drawGridLine(x1, y1, x2, y2, data->color);
+   }
 
    fb.show();
 }
@@ -127,74 +134,77 @@ void ColorWash::drawOnBeatSync(FrameTimingInfo *frameTiming) {
 }
 
 void ColorWash::drawOnFrameSync(FrameTimingInfo *frameTiming) {
-   int limit = 0xFF;
-
-   switch (data->mode) {
-      case 0: // medium bright
-         limit = 0x80;
-         break;
-      case 1: // bright, fade 1
-         fb.fadeScreenByStep(16, 10);
-         break;
-      case 2: // bright, fade 2
-         fb.fadeScreenByScale(0.9);
-         break;
-   }
-
-   if (!data->step) {
-      int oldColor = data->color;
-      data->direction = random(8);
-      // avoid choosing same color (regardless of brightness)
-      while (fb.colorHasSameComponents(data->color, oldColor)) {
-         data->color = fb.randomPrimaryOrSecondary(limit);
+   // one line per step, fading as it goes
+   for (int n = data->stepTimer.steps(frameTiming, ROUTINE_STEP_MICROS); n; n--) {
+      int limit = 0xFF;
+
+      switch (data->mode) {
+         case 0: // medium bright
+            limit = 0x80;
+            break;
+         case 1: // bright, fade 1
+            fb.fadeScreenByStep(16, 10);
+            break;
+         case 2: // bright, fade 2
+            fb.fadeScreenByScale(0.9);
+            break;
       }
-   }
 
-   int& step = data->step;    // aliases to avoid having to say data->
-   int& color = data->color;  // in all the cases below
-   int end;
+      if (!data->step) {
+         int oldColor = data->color;
+         data->direction = random(8);
+         // avoid choosing same color (regardless of brightness)
+         while (fb.colorHasSameComponents(data->color, oldColor)) {
+            data->color = fb.randomPrimaryOrSecondary(limit);
+         }
+      }
 
-   switch (data->direction) {
-      case 0: // top to bottom
-         end = fb.height;
-         fb.drawGridLine(0, step, end - 1, step, color);
-         break;
-      case 1: // bottom to top
-         end = fb.height;
-         fb.drawGridLine(0, end - 1 - step, end - 1, end - 1 - step, color);
-         break;
-      case 2: // left to right
-         end = fb.width;
-         fb.drawGridLine(step, 0, step, end - 1, color);
-         break;
-      case 3: // right to left
-         end = fb.width;
-         fb.drawGridLine(end - 1 - step, 0, end - 1 - step, end - 1, color);
-         break;
-      case 4: // diagonal 2 corners to middle
-         end = max(fb.width, fb.height);
-         fb.drawGridLine(0, step, step, 0, color);
-         fb.drawGridLine(end - 1, end - 1 - step, end - 1 - step, end - 1, color);
-         break;
-      case 5: // diagonal middle out to 2 corners
-         end = max(fb.width, fb.height);
-         fb.drawGridLine(0, end - 1 - step, end - 1 - step, 0, color);
-         fb.drawGridLine(end - 1, step, step, end - 1, color);
-         break;
-      case 6: // other diagonal 2 corners to middle
-         end = max(fb.width, fb.height);
-         fb.drawGridLine(0, end - 1 - step, step, end - 1, color);
-         fb.drawGridLine(end - 1, step, end - 1 - step, 0, color);
-         break;
-      case 7: // other  diagonal middle out to 2 corners
-         end = max(fb.width, fb.height);
-         fb.drawGridLine(0, step, end - 1 - step, end - 1, color);
-         fb.drawGridLine(end - 1, end - 1 - step, step, 0, color);
-         break;
-      default:
-         return;
+      int& step = data->step;    // aliases to avoid having to say data->
+      int& color = data->color;  // in all the cases below
+      int end;
+
+      switch (data->direction) {
+         case 0: // top to bottom
+            end = fb.height;
+            fb.drawGridLine(0, step, end - 1, step, color);
+            break;
+         case 1: // bottom to top
+            end = fb.height;
+            fb.drawGridLine(0, end - 1 - step, end - 1, end - 1 - step, color);
+            break;
+         case 2: // left to right
+            end = fb.width;
+            fb.drawGridLine(step, 0, step, end - 1, color);
+            break;
+         case 3: // right to left
+            end = fb.width;
+            fb.drawGridLine(end - 1 - step, 0, end - 1 - step, end - 1, color);
+            break;
+         case 4: // diagonal 2 corners to middle
+            end = max(fb.width, fb.height);
+            fb.drawGridLine(0, step, step, 0, color);
+            fb.drawGridLine(end - 1, end - 1 - step, end - 1 - step, end - 1, color);
+            break;
+         case 5: // diagonal middle out to 2 corners
+            end = max(fb.width, fb.height);
+            fb.drawGridLine(0, end - 1 - step, end - 1 - step, 0, color);
+            fb.drawGridLine(end - 1, step, step, end - 1, color);
+            break;
+         case 6: // other diagonal 2 corners to middle
+            end = max(fb.width, fb.height);
+            fb.drawGridLine(0, end - 1 - step, step, end - 1, color);
+            fb.drawGridLine(end - 1, step, end - 1 - step, 0, color);
+            break;
+         case 7: // other  diagonal middle out to 2 corners
+            end = max(fb.width, fb.height);
+            fb.drawGridLine(0, step, end - 1 - step, end - 1, color);
+            fb.drawGridLine(end - 1, end - 1 - step, step, 0, color);
+            break;
+         default:
+            return;
+      }
+      data->step = (data->step + 1) % end;
    }
-   data->step = (data->step + 1) % end;
 
    fb.show();
 }
@@ -259,17 +269,18 @@ void ThrobRoutine::begin(void *stateBuf) {
 }
 
 void ThrobRoutine::drawOnFrameSync(FrameTimingInfo *frameTiming) {
-   if (!data->step) {
+   // one throb per measure, with a new color each time
+   data->phase += data->phaseTimer.perBeat(frameTiming, 0x10000 / 4);
+   if (data->phase > 0xFFFF || !data->color) {
+      data->phase &= 0xFFFF;
       data->color = fb.randomColor(0x80);
    }
 
-   int numSteps = frameTiming->beatLength * 4 / frameTiming->frameLength;
-   int center = numSteps / 2;
-   int dist = abs(center - data->step);
+   int center = 0x8000;
+   int dist = abs(center - (int)data->phase);
    float scale = float(center - dist) / center;
    scale = scale * scale * scale; // decay faster
    int color = fb.scalePixel(data->color, scale);
-   data->step = (data->step + 1) % numSteps;
 
    fb.fillScreen(color);
    fb.show();
@@ -282,8 +293,8 @@ void GeoGrow::begin(void *stateBuf) {
    data = (Data *) stateBuf;
    memset(data, 0, sizeof *data);
 
-   data->end = max(fb.width, fb.height) / 2 * 1.5; // 1.5 is arbitrary to make it bleed off edge
-   data->sizeStep = data->end / 30.0; // target one growth per second
+   data->end = toFixed(max(fb.width, fb.height)) / 2 * 3 / 2; // 1.5 is arbitrary to make it bleed off edge
+   data->growthRate = data->end; // target one growth per second
 }
 
 void GeoGrow::adjustParam(int step) {
@@ -302,20 +313,23 @@ void GeoGrow::drawOnFrameSync(FrameTimingInfo *frameTiming) {
       int limit = 0xFF >> (2 * (numBrightSteps - 1 - data->brightness));
       data->current.color = fb.randomColor(limit);
       data->current.numSides = random(3, 9);
-      data->current.rotation = M_PI / 128.0 * random(256);
-      data->current.cx = fb.width / 2;
-      data->current.cy = fb.height / 2;
+      data->current.rotation = random(256) << 8;
+      data->current.cx = toFixed(fb.width - 1) / 2; // dead center, between pixels
+      data->current.cy = toFixed(fb.height - 1) / 2;
       if (data->mode == 1) {
          int xOfs = fb.width / 2;
          int yOfs = fb.height / 2;
-         data->current.cx += random(xOfs) - xOfs / 2;
-         data->current.cy += random(yOfs) - yOfs / 2;
+         data->current.cx += toFixed(random(xOfs) - xOfs / 2);
+         data->current.cy += toFixed(random(yOfs) - yOfs / 2);
       }
    }
 
-   // compute this pass
-   data->current.size += data->sizeStep;
-   addToHistory();
+   // compute this pass; the trail of fading echoes behind it is laid down
+   // at a fixed pace, however fast the frames come
+   data->current.size += data->growthTimer.perSecond(frameTiming, data->growthRate);
+   for (int n = data->echoTimer.steps(frameTiming, ROUTINE_STEP_MICROS); n; n--) {
+      addToHistory();
+   }
    drawFromHistory();
 
    if (data->current.size >= data->end) {
@@ -332,31 +346,45 @@ void GeoGrow::addToHistory() {
    // overwrite next entry and make it active
    step->active = true;
    step->color = data->current.color;
+   step->fade = 0x10000;
    step->numSides = data->current.numSides;
    step->cx = data->current.cx;
    step->cy = data->current.cy;
    step->rotation = data->current.rotation;
    step->size = data->current.size;
 
-   // fade remaining steps
+   // fade remaining steps; kept as a separate scale so the color is only
+   // rounded once, when it's drawn
    for (int i = 0; i < limit; i++) {
       if (i == data->ringIndex) continue;
       step = data->historyRingBuf + i;
-      step->color = fb.scalePixel(step->color, 0.7);
+      step->fade = step->fade * 179 >> 8; // 0.7
    }   
 
    // advance ring pointer
    data->ringIndex = (data->ringIndex + 1) % limit;
 }
 
+void GeoGrow::setQuality(const QualityInfo *quality) {
+   int limit = ARRAYSIZE(data->historyRingBuf);
+   data->numEchoes = limit * quality->effects / 256;
+}
+
 void GeoGrow::drawFromHistory() {
+   // oldest first, so the newer ones draw over them; at lower quality,
+   // only the newest few
    int limit = ARRAYSIZE(data->historyRingBuf);
-   for (int i = 0; i < limit; i++) {
-      Step *step = data->historyRingBuf + i;
+   for (int age = data->numEchoes; age > 0; age--) {
+      Step *step = data->historyRingBuf + (data->ringIndex - age + limit) % limit;
       if (step->active) {
-         fb.drawNGram(step->cx, step->cy, step->numSides, step->size, step->rotation, step->color);
+         int color = fb.scalePixelFixed(step->color, step->fade >> 8);
+         rasterNGram(step->cx, step->cy, step->numSides, step->size, step->rotation, color);
       }
    }   
+
+   // and the current one on top, at full brightness
+   Step *current = &data->current;
+   rasterNGram(current->cx, current->cy, current->numSides, current->size, current->rotation, current->color);
 }
 
 
@@ -439,6 +467,10 @@ void TranslucentSquares::adjustParam(int step) {
 }
 
 void TranslucentSquares::drawOnFrameSync(FrameTimingInfo *frameTiming) {
+   // one pixel per step; in between, nothing to redraw
+   int steps = data->stepTimer.steps(frameTiming, ROUTINE_STEP_MICROS);
+   if (!steps) return;
+
    fb.clearScreen();
    for (int i = 0; i < numSquares; i++) {
       Square *s = data->square + i;
@@ -453,31 +485,37 @@ void TranslucentSquares::drawOnFrameSync(FrameTimingInfo *frameTiming) {
             fb.setGridPixel(x, y, pixel);
          }
       }
+   }
 
-      // move, and if offscreen, bounce
-      s->x += s->dx;
-      s->y += s->dy;
-
-      if (s->x < 0) {
-         s->x = 0;
-         s->dx = 1;
-         s->dy = random(3) - 1;
-      } else if (s->x + s->size >= fb.width) {
-         s->x = fb.width - s->size;
-         s->dx = -1;
-         s->dy = random(3) - 1;
-      }
+   // move, and if offscreen, bounce
+   for (int n = 0; n < steps; n++) {
+      for (int i = 0; i < numSquares; i++) {
+         Square *s = data->square + i;
+         s->x += s->dx;
+         s->y += s->dy;
+
+         if (s->x < 0) {
+            s->x = 0;
+            s->dx = 1;
+            s->dy = random(3) - 1;
+         } else if (s->x + s->size >= fb.width) {
+            s->x = fb.width - s->size;
+            s->dx = -1;
+            s->dy = random(3) - 1;
+         }
 
-      if (s->y < 0) {
-         s->y = 0;
-         s->dy = 1;
-         s->dx = random(3) - 1;
-      } else if (s->y + s->size >= fb.height) {
-         s->y = fb.height - s->size;
-         s->dy = -1;
-         s->dx = random(3) - 1;
+         if (s->y < 0) {
+            s->y = 0;
+            s->dy = 1;
+            s->dx = random(3) - 1;
+         } else if (s->y + s->size >= fb.height) {
+            s->y = fb.height - s->size;
+            s->dy = -1;
+            s->dx = random(3) - 1;
+         }
       }
    }
+
    fb.showWithLimit();
 }
 
@@ -488,36 +526,38 @@ void SwirlRoutine::begin(void *stateBuf) {
    data = (Data *) stateBuf;
    memset(data, 0, sizeof *data);
 
-   data->cx = fb.width / 2;
-   data->cy = fb.width / 2;
+   data->cx = toFixed(fb.width / 2);
+   data->cy = toFixed(fb.width / 2);
+   adjustParam(0);
 }
 
-void SwirlRoutine::adjustParam(int step) {
-   int delta = millis() - data->lastClick;
-   int delta2 = data->lastClick - data->olderClick;
-   if (delta > 100 && delta < 300 && delta2 > 100 && delta2 < 300) {
-      // triple click: start wandering around
-      data->dcx = random(5) - 2;
-      data->dcy = random(5) - 2;
-      data->brightness = (data->brightness - 2 + numBrightSteps) % numBrightSteps;
-   } else if (delta > 100 && delta < 300) {
-      // double click: move center to new location
-      data->cx = random(fb.width);
-      data->cy = random(fb.height);
-      data->dcx = 0;
-      data->dcy = 0;
-      data->brightness = (data->brightness - 1 + numBrightSteps) % numBrightSteps;
-   } else {
-     // single click: moderate brightness
-      data->brightness = (data->brightness + step + numBrightSteps) % numBrightSteps;
-   }
-
-   data->olderClick = data->lastClick;
-   data->lastClick = millis();
+void SwirlRoutine::onGesture(GestureType gesture, int step) {
+   switch (gesture) {
+      case GESTURE_CLICK:
+         // moderate brightness
+         adjustParam(step);
+         break;
+      case GESTURE_DOUBLE_CLICK:
+         // move center to new location, and undo the click's brightness
+         data->cx = toFixed(random(fb.width));
+         data->cy = toFixed(random(fb.height));
+         data->dcx = 0;
+         data->dcy = 0;
+         startMap();
+         adjustParam(-step);
+         break;
+      case GESTURE_TRIPLE_CLICK:
+         // start wandering around
+         data->dcx = random(5) - 2;
+         data->dcy = random(5) - 2;
+         break;
+      default:
+         break;
+   }
 }
 
-void SwirlRoutine::drawOnFrameSync(FrameTimingInfo *frameTiming) {
-   static const int swirlColors[7] = {
+void SwirlRoutine::adjustParam(int step) {
+   static const int swirlColors[numColors] = {
       0x600000, // red
       0x502000, // orange
       0x404000, // yellow
@@ -526,50 +566,117 @@ void SwirlRoutine::drawOnFrameSync(FrameTimingInfo *frameTiming) {
       0x000060, // blue
       0x400040, // purple
    };
-   float brightScale = 1.0 / (1 << 2 * (numBrightSteps - data->brightness - 1));
-
-   // draw
-   for (int x = 0; x < fb.width; x++) {
-      for (int y = 0; y < fb.height; y++) {
-         float dx = x - data->cx + 0.5;
-         float dy = y - data->cy + 0.5;
-
-         // calculate angle, with offset
-         // and offset range from [-pi, pi] to [0, 2 * pi]
-         float angle = atan2(dy, dx);
-         angle += data->angleOffset + M_PI;
-         if (angle > 2 * M_PI) {
-            angle -= 2 * M_PI;
-         }
 
-         // bin by number of colors
-         float scale = angle / (2 * M_PI); // on scale of 0 to 1 now
-         int bin = scale * ARRAYSIZE(swirlColors);
+   data->brightness = (data->brightness + step + numBrightSteps) % numBrightSteps;
+   int brightScale = 256 >> 2 * (numBrightSteps - data->brightness - 1);
+   for (int i = 0; i < numColors; i++) {
+      data->palette[i] = fb.scalePixelFixed(swirlColors[i], brightScale);
+   }
+}
+
+void SwirlRoutine::startMap() {
+   int res = data->resolution;
+   data->mapResolution = res;
+   data->mapCols = (fb.width + res - 1) / res;
+   data->mapRows = (fb.height + res - 1) / res;
+   data->mapCx = data->cx;
+   data->mapCy = data->cy;
+   if (data->mapCols * data->mapRows > maxMapBlocks) {
+      // too big to keep; drawOnFrameSync works it out as it goes
+      data->rebuildRow = data->mapRows;
+      return;
+   }
+   for (int row = 0; row < data->mapRows; row++) {
+      buildMapRow(row);
+   }
+   data->rebuildRow = data->mapRows;
+}
 
-         int color = fb.scalePixel(swirlColors[bin], brightScale);
-         fb.setGridPixel(x, y, color);
+void SwirlRoutine::buildMapRow(int row) {
+   // angles of the blocks' centers, offset by half a turn so the colors
+   // start where they always have
+   int res = data->resolution;
+   int dy = toFixed(row * res) + res * FIXED_ONE / 2 - data->mapCy;
+   uint8_t *angle = data->angleMap + row * data->mapCols;
+   for (int col = 0; col < data->mapCols; col++) {
+      int dx = toFixed(col * res) + res * FIXED_ONE / 2 - data->mapCx;
+      *angle++ = (fixedAtan2(dy, dx) + 0x8000) >> 8;
+   }
+}
+
+bool SwirlRoutine::workBetweenFrames(FrameTimingInfo *frameTiming) {
+   if (!data->mapResolution) {
+      return false; // no frames yet
+   }
+   if (data->rebuildRow >= data->mapRows) {
+      if (data->cx == data->mapCx && data->cy == data->mapCy) {
+         return false;
       }
+      // the center's moved on; catch the map up with where it is now
+      data->mapCx = data->cx;
+      data->mapCy = data->cy;
+      data->rebuildRow = 0;
    }
-   fb.showWithLimit();
 
-   // rotate; angle depends on beat-match speed
-   float speedFactor = (frameTiming->frameLength * 15.0 / frameTiming->beatLength) / 6.0;
-   data->angleOffset += 2 * M_PI / numSteps * speedFactor; // 2*PI/steps is angle of each step
-   if (data->angleOffset > 2 * M_PI) {
-      data->angleOffset -= 2 * M_PI;
+   uint32_t start = micros();
+   while (data->rebuildRow < data->mapRows && micros() - start < rebuildBudgetMicros) {
+      buildMapRow(data->rebuildRow++);
+   }
+   return true;
+}
+
+void SwirlRoutine::drawOnFrameSync(FrameTimingInfo *frameTiming) {
+   int res = data->resolution;
+   if (data->mapResolution != res) {
+      startMap();
+   }
+   bool mapped = data->mapCols * data->mapRows <= maxMapBlocks;
+
+   // draw; at lower quality, one angle per block of pixels
+   uint8_t offset = data->angleOffset >> 16;
+   const uint8_t *angle = data->angleMap;
+   for (int y = 0; y < fb.height; y += res) {
+      for (int x = 0; x < fb.width; x += res) {
+         uint8_t a = mapped ? *angle++ :
+            (fixedAtan2(toFixed(y) + res * FIXED_ONE / 2 - data->cy,
+                        toFixed(x) + res * FIXED_ONE / 2 - data->cx) + 0x8000) >> 8;
+         int bin = (uint8_t)(a + offset) * numColors >> 8;
+         int color = data->palette[bin];
+         if (res == 1) {
+            fb.setGridPixel(x, y, color);
+         } else {
+            fb.fillRect(x, y, x + res - 1, y + res - 1, color);
+         }
+      }
    }
+   fb.showWithLimit();
+
+   // rotate; 2.5 steps of 1/numSteps turn a beat
+   data->angleOffset += data->angleTimer.perBeat(frameTiming, (0x10000 * 15 / (numSteps * 6)) << 8);
 
-   // and maybe move center
-   data->cx += data->dcx / 12.0;
-   data->cy += data->dcy / 12.0;
-   if (data->cx < 0 || data->cx >= fb.width) {
-      data->dcx *= -1;
+   // and maybe move center, dcx / 12 pixels a step
+   int stepsPerSecond = 1000000 / ROUTINE_STEP_MICROS;
+   data->cx += data->cxTimer.perSecond(frameTiming, data->dcx * FIXED_ONE * stepsPerSecond / 12);
+   data->cy += data->cyTimer.perSecond(frameTiming, data->dcy * FIXED_ONE * stepsPerSecond / 12);
+   // bounce off the edges; by heading away from them rather than turning
+   // round, since with the fraction carried it may take a few frames to
+   // get back inside
+   if (data->cx < 0) {
+      data->dcx = abs(data->dcx);
+   } else if (data->cx >= toFixed(fb.width)) {
+      data->dcx = -abs(data->dcx);
    }
-   if (data->cy < 0 || data->cy >= fb.height) {
-      data->dcy *= -1;
+   if (data->cy < 0) {
+      data->dcy = abs(data->dcy);
+   } else if (data->cy >= toFixed(fb.height)) {
+      data->dcy = -abs(data->dcy);
    }
 }
 
+void SwirlRoutine::setQuality(const QualityInfo *quality) {
+   data->resolution = quality->resolution;
+}
+
 
 
 void SnakeRoutine::begin(void *stateBuf) {
@@ -577,18 +684,20 @@ void SnakeRoutine::begin(void *stateBuf) {
    data = (Data *) stateBuf;
    memset(data, 0, sizeof *data);
 
-   data->lastClick = millis() - 200;
    adjustParam(0);
 }
 
-void SnakeRoutine::adjustParam(int step) {
-   // if this was a double-click, clear the screen
-   int delta = millis() - data->lastClick;
-   if (delta > 100 && delta < 300) {
+void SnakeRoutine::onGesture(GestureType gesture, int step) {
+   // double-click clears the screen, and any click starts a new snake
+   if (gesture == GESTURE_DOUBLE_CLICK) {
       fb.clearScreen();
    }
-   data->lastClick = millis();
+   if (gesture != GESTURE_HOLD) {
+      adjustParam(step);
+   }
+}
 
+void SnakeRoutine::adjustParam(int step) {
    // randomize parameters to start new snake
    data->x = random(fb.width);
    data->y = random(fb.height);
@@ -600,46 +709,50 @@ void SnakeRoutine::adjustParam(int step) {
 }
 
 void SnakeRoutine::drawOnFrameSync(FrameTimingInfo *frameTiming) {
-   // brighten pixel
-   int pixel = fb.getGridPixel(data->x, data->y);
-   pixel = fb.addPixelComponents(pixel, data->color);
-   fb.setGridPixel(data->x, data->y, pixel);
-   fb.showWithLimit();
+   // one pixel per step
+   for (int n = data->stepTimer.steps(frameTiming, ROUTINE_STEP_MICROS); n; n--) {
+      // brighten pixel
+      int pixel = fb.getGridPixel(data->x, data->y);
+      pixel = fb.addPixelComponents(pixel, data->color);
+      fb.setGridPixel(data->x, data->y, pixel);
+
+      // move
+      switch (data->direction) {
+         case RIGHT: data->x += 1; break;
+         case UP: data->y += 1; break;
+         case LEFT: data->x -= 1; break;
+         case DOWN: data->y -= 1; break;
+      }
 
-   // move
-   switch (data->direction) {
-      case RIGHT: data->x += 1; break;
-      case UP: data->y += 1; break;
-      case LEFT: data->x -= 1; break;
-      case DOWN: data->y -= 1; break;
-   }
+      // keep onscreen
+      if (data->x < 0) {
+         data->x = 0;
+         while (data->direction == LEFT) newDirection();
+      }
+      if (data->x >= fb.width) {
+         data->x = fb.width - 1;
+         while (data->direction == RIGHT) newDirection();
+      }
+      if (data->y < 0) {
+         data->y = 0;
+         while (data->direction == DOWN) newDirection();
+      }
+      if (data->y >= fb.height) {
+         data->y = fb.height - 1;
+         while (data->direction == UP) newDirection();
+      }
 
-   // keep onscreen
-   if (data->x < 0) {
-      data->x = 0;
-      while (data->direction == LEFT) newDirection();
-   }
-   if (data->x >= fb.width) {
-      data->x = fb.width - 1;
-      while (data->direction == RIGHT) newDirection();
-   }
-   if (data->y < 0) {
-      data->y = 0;
-      while (data->direction == DOWN) newDirection();
-   }
-   if (data->y >= fb.height) {
-      data->y = fb.height - 1;
-      while (data->direction == UP) newDirection();
+      // randomize direction once in a while
+      // (more likely at edge of screen, to avoid getting stuck)
+      bool atEdge = (data->x == 0 || data->x == fb.width - 1
+                  || data->y == 0 || data->y == fb.height - 1);
+      int likely = atEdge ? fb.width / 3 : fb.width * 2;
+      if (!random(likely)) {
+         newDirection();
+      }
    }
 
-   // randomize direction once in a while
-   // (more likely at edge of screen, to avoid getting stuck)
-   bool atEdge = (data->x == 0 || data->x == fb.width - 1
-               || data->y == 0 || data->y == fb.height - 1);
-   int likely = atEdge ? fb.width / 3 : fb.width * 2;
-   if (!random(likely)) {
-      newDirection();
-   }
+   fb.showWithLimit();
 }
 
 void SnakeRoutine::newDirection() {
@@ -658,6 +771,7 @@ void DripRoutine::begin(void *stateBuf) {
    memset(data, 0, sizeof *data);
 
    data->trailLength = 4;
+   data->drops.begin();
    fb.clearScreen();
 }
 
@@ -674,62 +788,23 @@ void DripRoutine::drawOnBeatSync(FrameTimingInfo *frameTiming) {
 }
 
 void DripRoutine::drawOnFrameSync(FrameTimingInfo *frameTiming) {
-   int i;
-
-   // existing points: draw, then drip down
-   for (i = 0; i < maxTrails; i++) {
-      PointTrail *trail = data->trails + i;
-      if (!trail->active) continue;
-
-      int color = trail->color;
-      int y;
-      for (y = trail->y; y < trail->y + data->trailLength; y++) {
-         fb.setGridPixel(trail->x, y, color);
-         color = fb.scalePixel(color, 0.8);
-      }
-      // one extra draw to erase behind trail
-      fb.setGridPixel(trail->x, y, 0);
-
-      // the enemy's gate is down
-      trail->y--;
-
-      // check for expire
-      if (trail->y < -data->trailLength) {
-         trail->active = false;
+   // drip a pixel per step
+   for (int n = data->stepTimer.steps(frameTiming, ROUTINE_STEP_MICROS); n; n--) {
+      // existing points: draw, then drip down, till the trail's off the bottom
+      data->drops.renderTrails(data->trailLength, 205); // 0.8
+      data->drops.update(data->trailLength);
+
+      // check for add of new point
+      if (!random(fb.width / 2)) {
+         addPoint(0x40);
       }
    }
 
    fb.showWithLimit();
-
-   // consolidate point array, keeping in order
-   PointTrail *keepers = data->trails;
-   for (PointTrail *trail = data->trails; trail < data->trails + maxTrails; trail++) {
-      if (trail->active) {
-         if (keepers != trail) {
-            *keepers = *trail;
-         }
-         keepers++;
-      }
-   }
-
-   // check for add of new point
-   if (!random(fb.width / 2)) {
-      addPoint(0x40);
-   }
 }
 
 void DripRoutine::addPoint(int colorLimit) {
-   int numActive = 0;
-   for (int i = 0; i < maxTrails; i++) {
-      if (data->trails[i].active) {
-         numActive++;
-      }
-   }
-   if (numActive < maxTrails) {
-      PointTrail *trail = data->trails + numActive;
-      trail->x = random(fb.width);
-      trail->y = fb.height;
-      trail->color = fb.randomPrimaryOrSecondary(colorLimit);
-      trail->active = true;
-   }
+   // the enemy's gate is down
+   data->drops.add(toFixed(random(fb.width)), toFixed(fb.height), 0, -FIXED_ONE,
+                   fb.randomPrimaryOrSecondary(colorLimit));
 }
@@ -1,13 +1,86 @@
 #pragma once
 
+#include "gesture.h"
+#include "particles.h"
+#include "automaton.h"
+
 static const size_t ROUTINE_STATEBUF_SIZE = 1024; // 1K oughtta be enough for anybody. Right?
 
 
+static const uint32_t ROUTINE_STEP_MICROS = 33000; // the ~30 fps pace routines were tuned at
+
+
+/*
+ * Frames come as fast as the current routine can draw them (see Scene), so
+ * the rate varies with the routine and even from frame to frame. Animate by
+ * the time that has passed, not per call (see StepTimer and RateTimer).
+ */
 class FrameTimingInfo {
 public:
-   int beatLength;    // ms per beat (typically 500)
-   int frameLength;   // ms per frame (typically 33)
-   int beatRelative;  // how long since the last beat
+   int beatLength;     // ms per beat (typically 500)
+   int beatRelative;   // ms since the last beat
+   uint16_t beatPhase; // how far through the beat, 0 - 65535
+   uint32_t elapsed;   // us since the previous drawOnFrameSync (0 for the first)
+   unsigned long time; // ms since the routine began
+};
+
+
+/*
+ * How much work to put into a frame. The scene lowers quality when a
+ * routine's frames take longer than its budget, and raises it again when
+ * there's room (see Scene::governQuality).
+ */
+class QualityInfo {
+public:
+   int level;      // 0 is full quality; higher is cheaper
+   int resolution; // compute 1 in this many pixels each way, and fill blocks
+   int effects;    // how many sparkles, echoes and such to draw, of 256
+   bool dither;    // temporal dithering (the scene applies this one)
+};
+
+
+/*
+ * For animations that move in whole steps (a pixel at a time, say): how many
+ * steps of the given length are due, carrying the rest of the time over.
+ * Lives in the routine's Data, so starts out zeroed.
+ */
+class StepTimer {
+public:
+   int steps(FrameTimingInfo *frameTiming, uint32_t stepMicros) {
+      carry += frameTiming->elapsed;
+      int n = carry / stepMicros;
+      carry -= n * stepMicros;
+      return n;
+   }
+
+   uint32_t carry;
+};
+
+
+/*
+ * For things that move at a rate (units per second, or per beat): how far
+ * they've moved since the previous frame, in whole units, carrying the
+ * fraction over. Without the carry, a slow rate at a fast frame rate
+ * rounds to nothing every frame. Lives in the routine's Data, one per
+ * moving thing, so starts out zeroed.
+ */
+class RateTimer {
+public:
+   int perSecond(FrameTimingInfo *frameTiming, int rate) {
+      return advance((int64_t)rate * frameTiming->elapsed, 1000000);
+   }
+   int perBeat(FrameTimingInfo *frameTiming, int rate) {
+      return advance((int64_t)rate * frameTiming->elapsed, frameTiming->beatLength * 1000);
+   }
+
+   int advance(int64_t amount, int64_t per) {
+      carry += amount;
+      int n = carry / per;
+      carry -= n * per;
+      return n;
+   }
+
+   int64_t carry; // rate x us, less than a unit's worth
 };
 
 
@@ -16,13 +89,27 @@ public:
    // subclasses must implement begin and drawOnFrameSync
    // the rest are optional
    virtual void begin(void *stateBuf) = 0;
+   // the param buttons: by default, every click steps the param
+   virtual void onGesture(GestureType gesture, int step) {
+      if (gesture != GESTURE_HOLD) {
+         adjustParam(step);
+      }
+   };
    virtual void adjustParam(int step) {};
    virtual void startBeatMeasure() {};
    virtual void drawOnBeatSync(FrameTimingInfo *frameTiming) {};
    virtual void drawOnFrameSync(FrameTimingInfo *frameTiming) = 0;
+   // between frames: draw and show a frame of its own, returning true if
+   // it did; or else catch up on work that shows nothing yet (true if
+   // there was any), while the idle time dithers the current frame
    virtual bool drawBetweenFrames(FrameTimingInfo *frameTiming) {
       return false;
    };
+   virtual bool workBetweenFrames(FrameTimingInfo *frameTiming) {
+      return false;
+   };
+   // called after begin and whenever the quality level changes
+   virtual void setQuality(const QualityInfo *quality) {};
 };
 
 
@@ -37,6 +124,7 @@ public:
       int oldX;
       int oldY;
       int color;
+      StepTimer stepTimer;
    } Data;
    Data *data;
 };
@@ -56,24 +144,99 @@ public:
       int color;
       int beat;
       int skipErase;
+      StepTimer stepTimer;
    } Data;
    Data *data;
 };
 
 
+/*
+ * Plasma: each channel a cosine of a cosine of the position and time. The
+ * terms that depend on only the column (or only the row) are worked out
+ * once a frame (or once a row), so each pixel costs just the lookups that
+ * couple the two. Several families of pattern; double-click for the next.
+ */
 class PlasmaRoutine: public Routine {
 public:
    void begin(void *stateBuf);
+   void onGesture(GestureType gesture, int step);
    void adjustParam(int step);
-   void drawOnBeatSync(FrameTimingInfo *frameTiming);
    void drawOnFrameSync(FrameTimingInfo *frameTiming);
    bool drawBetweenFrames(FrameTimingInfo *frameTiming);
+   void setQuality(const QualityInfo *quality);
+
+   typedef enum {
+      FAMILY_CLASSIC, // the original: nested waves, a different one per channel
+      FAMILY_RINGS,   // ripples out from a drifting center
+      FAMILY_WAVES,   // three crossing waves, through a rainbow
+      NUM_FAMILIES
+   } Family;
+
+   static const int maxColumns = 256;
 
    typedef struct {
-      unsigned long frameCount;
-      int allowedBright;
-      int maxAllowedBright;
+      int resolution;
+      int brightMillis; // unlimited for this long after each beat; -1 for always
       int step;
+      int family;
+      int scale; // table steps per pixel, so bigger canvases get as many waves
+      // per column, this frame
+      uint8_t colA[maxColumns];
+      uint8_t colB[maxColumns];
+      uint8_t colC[maxColumns];
+   } Data;
+   Data *data;
+};
+
+
+/*
+ * What the microphone hears (see audio.h), as bars or a scrolling
+ * spectrogram: a windowed fixed-point FFT of the latest samples, a step
+ * at a time in workBetweenFrames, binned into log-spaced bands, one per
+ * column or so.
+ */
+class SpectrumRoutine: public Routine {
+public:
+   static const int fftSize = 128;      // 62.5 Hz bins at 8 kHz
+   static const int fftStages = 7;      // log2(fftSize)
+   static const int blockHop = 64;      // samples from one block to the next
+   static const int maxBars = 16;
+   static const uint32_t stepBudgetMicros = 100; // per workBetweenFrames
+   static const uint32_t rowMicros = 50000;      // spectrogram scroll
+
+   void begin(void *stateBuf);
+   void adjustParam(int step);
+   void drawOnFrameSync(FrameTimingInfo *frameTiming);
+   bool workBetweenFrames(FrameTimingInfo *frameTiming);
+
+   bool step(); // false if waiting for samples
+   void loadBlock();
+   void butterflies(int stage);
+   void measureBands();
+   int barHeight(int level); // 8.8 fixed pixels
+
+   typedef enum {
+      MODE_BARS,
+      MODE_PEAKS, // bars, and where they got to
+      MODE_SPECTROGRAM,
+      NUM_MODES
+   } Mode;
+
+   typedef struct {
+      int16_t re[fftSize];
+      int16_t im[fftSize];
+      int stage;          // 0 waiting for samples, then each FFT stage, then the bands
+      uint32_t nextBlock; // audio.samplesIn to take the next block at
+      int numBars;
+      uint8_t bandStart[maxBars + 1]; // FFT bins
+      int16_t level[maxBars]; // log power, 1/32 octaves, as of the last block
+      int16_t shown[maxBars]; // bar heights, 8.8 fixed pixels
+      int16_t peak[maxBars];
+      int top;            // the loudest band lately, 1/512 octaves
+      int mode;
+      StepTimer rowTimer;
+      RateTimer fallTimer;
+      RateTimer peakFallTimer;
    } Data;
    Data *data;
 };
@@ -91,6 +254,7 @@ public:
       int color;
       int direction;
       int mode; // 0-2, controls brightness and fade behavior
+      StepTimer stepTimer;
    } Data;
    Data *data;
 };
@@ -119,7 +283,8 @@ public:
 
    typedef struct {
       int color;
-      int step;
+      uint32_t phase; // through a measure (4 beats), 0 - 65535
+      RateTimer phaseTimer;
    } Data;
    Data *data;
 };
@@ -131,30 +296,36 @@ public:
    void adjustParam(int step);
    void drawOnBeatSync(FrameTimingInfo *frameTiming);
    void drawOnFrameSync(FrameTimingInfo *frameTiming);
+   void setQuality(const QualityInfo *quality);
 
    static const int numBrightSteps = 4;
 
+   // positions and sizes are 24.8 fixed point, see raster.h
    typedef struct {
       bool active;
       int color;
+      int fade; // brightness, 0x10000 == color at full
       int cx;
       int cy;
       int numSides;
-      float rotation;
-      float size;
+      uint16_t rotation;
+      int size;
    } Step;
 
    typedef struct {
       // constant
       int end;
-      float sizeStep;
+      int growthRate; // per second
       // param
       int brightness;
       int mode;
+      int numEchoes; // how much of the history to draw
       // current pass
       Step current;
+      RateTimer growthTimer;
       // history
       bool reset;
+      StepTimer echoTimer;
       int ringIndex;
       Step historyRingBuf[4];
    } Data;
@@ -203,28 +374,57 @@ public:
    typedef struct {
       Square square[numSquares];
       int brightness;
+      StepTimer stepTimer;
    } Data;
    Data *data;
 };
 
 
+/*
+ * Each pixel's angle from the center only changes when the center moves,
+ * so it's kept in a map; a frame is then an add and a palette lookup per
+ * pixel. While the center wanders, the map is brought up to date a few
+ * rows at a time in workBetweenFrames.
+ */
 class SwirlRoutine: public Routine {
 public:
    void begin(void *stateBuf);
+   void onGesture(GestureType gesture, int step);
    void adjustParam(int step);
    void drawOnFrameSync(FrameTimingInfo *frameTiming);
+   bool workBetweenFrames(FrameTimingInfo *frameTiming);
+   void setQuality(const QualityInfo *quality);
+
+   void buildMapRow(int row);
+   void startMap(); // from scratch, all at once
 
    static const int numBrightSteps = 4;
+   static const int numColors = 7;
+   static const int maxMapBlocks = 384; // 16x16 and 8x23 fit
+   static const uint32_t rebuildBudgetMicros = 100; // per workBetweenFrames
 
+   // positions are 24.8 fixed point, see raster.h; angles are binary
    typedef struct {
-      int lastClick;
-      int olderClick;
       int brightness;
-      float angleOffset;
-      float cx;
-      float cy;
+      uint32_t angleOffset; // 65536 a turn, with 8 more bits of fraction
+      int cx;
+      int cy;
       int dcx;
       int dcy;
+      RateTimer angleTimer;
+      RateTimer cxTimer;
+      RateTimer cyTimer;
+      int resolution;
+      int palette[numColors]; // at this brightness
+
+      // each block's angle from mapCx, mapCy, 256 a turn
+      uint8_t angleMap[maxMapBlocks];
+      int mapCx;
+      int mapCy;
+      int mapResolution;
+      int mapCols;
+      int mapRows;
+      int rebuildRow; // next to bring up to date; mapRows when it's done
    } Data;
    Data *data;
 
@@ -235,16 +435,17 @@ public:
 class SnakeRoutine: public Routine {
 public:
    void begin(void *stateBuf);
+   void onGesture(GestureType gesture, int step);
    void adjustParam(int step);
    void drawOnFrameSync(FrameTimingInfo *frameTiming);
 
    typedef enum { RIGHT, UP, LEFT, DOWN } Direction;
    typedef struct {
-      int lastClick;
       int x;
       int y;
       Direction direction;
       int color;
+      StepTimer stepTimer;
    } Data;
    Data *data;
 
@@ -253,6 +454,32 @@ private:
 };
 
 
+/*
+ * Cellular automata (see automaton.h): a generation a beat, and each frame
+ * crossfades from the one before to it. Cells are colored by their age, or
+ * for the cyclic rule their state. The param buttons pick the rule.
+ */
+class AutomatonRoutine: public Routine {
+public:
+   void begin(void *stateBuf);
+   void adjustParam(int step);
+   void drawOnBeatSync(FrameTimingInfo *frameTiming);
+   void drawOnFrameSync(FrameTimingInfo *frameTiming);
+
+   static const int maxQuietGenerations = 16;  // then reseed
+
+   typedef struct {
+      CellularAutomaton ca; // its cells are in automaton.cpp, sized to the canvas
+      int quietGenerations;
+   } Data;
+   Data *data;
+
+private:
+   void start();
+   int cellColor(int x, int y, bool previous);
+};
+
+
 class DripRoutine: public Routine {
 public:
    void begin(void *stateBuf);
@@ -264,15 +491,10 @@ public:
    static const int minTrailLength = 3;
    static const int maxTrailLength = 8;
 
-   typedef struct {
-      int x;
-      int y;
-      int color;
-      bool active;
-   } PointTrail;
    typedef struct {
       int trailLength;
-      PointTrail trails[maxTrails];
+      StepTimer stepTimer;
+      ParticleSystem<maxTrails> drops;
    } Data;
    Data *data;
 
@@ -3,6 +3,10 @@
 #include "routine.h"
 #include "scene.h"
 #include "control_pad.h"
+#include "framebuffer.h"
+#include "profile.h"
+#include "telemetry.h"
+#include "audio.h"
 
 #include "routine.h"
 #include "images.h"
@@ -19,27 +23,37 @@ Routine *routineTable[] = {
 };
 #undef USE
 
+#define USE(r)   #r, // names, for profiling
+const char *routineNames[] = {
+   Platform_DeclareRoutines
+};
+#undef USE
+
 
 const int numRoutines = ARRAYSIZE(routineTable);
 
-byte stateBuf[ROUTINE_STATEBUF_SIZE];
 
-#if DEBUG
-struct {
-   int beatCount;
-   int beatTime;
-   int frameCount;
-   int frameTime;
-   int tweenCount;
-   int tweenTime;
-} debugTimes;
-#endif
+// cheapest last; the governor moves one level at a time
+static const QualityInfo qualityLevels[] = {
+   // level, resolution, effects, dither
+   { 0, 1, 256, true },
+   { 1, 1, 256, false },
+   { 2, 1, 128, false },
+   { 3, 2, 128, false },
+   { 4, 2, 64, false },
+   { 5, 4, 32, false },
+};
+static_assert(ARRAYSIZE(qualityLevels) == Scene::numQualityLevels, "quality table doesn't match Scene");
+
+byte stateBuf[ROUTINE_STATEBUF_SIZE];
 
 void Scene::begin() {
    blink = FALSE;
+   beatTracker.begin(initialBeatLength * 1000);
    beatLength = initialBeatLength;
-   nextBeatTime = millis();
-   lastTimerPress = 0;
+   nextBeatTime = micros();
+   lastBeatTime = nextBeatTime - beatTracker.period;
+   nextFrameTime = nextBeatTime;
 
    whichRoutine = 0;
    onChooseNewRoutine(0);
@@ -47,94 +61,190 @@ void Scene::begin() {
 
 
 void Scene::loop() {
-   // always check for input, as often as possible
+   // always check for input, and feed the LEDs, as often as possible
    controls.sample();
+   fb.present();
 
-   int now = millis();
+   uint32_t now = micros();
    FrameTimingInfo frameTiming;
-   frameTiming.beatLength = beatLength;
-   frameTiming.frameLength = frameLength;
-   frameTiming.beatRelative = (now - nextBeatTime) % nextBeatTime;
 
    // beats are longer than frames. Check for beat timer elapse, which also implies
    // a frame advance; otherwise check for frame advance; otherwise spin till one of
    // those elapses (where by "spin", I mean check for input and allow cheap animations).
+   //
+   // Deadlines are absolute, so time spent drawing doesn't push the schedule
+   // back. Running late by less than a period, we catch up (the next one
+   // comes sooner); by more, the missed ones are dropped and counted, and we
+   // carry on from the next one on the same grid. The beat tracker may
+   // stretch or shrink a beat a little to bring the grid in line with taps.
+   if (DEADLINE_REACHED(nextBeatTime, now)) {
+      DebugPrint("New beat t=%lu\n", now);
+      uint32_t period = beatTracker.period;
+      uint32_t missed = (now - nextBeatTime) / period;
+      lastBeatTime = nextBeatTime + missed * period;
+      nextBeatTime = beatTracker.nextBeat(lastBeatTime);
+      profiler.record(PROFILE_BEAT_LATE, now - lastBeatTime);
+      profiler.recordDropped(PROFILE_BEAT_LATE, missed);
 
-   // DebugPrint("now %ld next %ld interbeat %d\n", now, nextBeatTime, beatTime);
-   if (now >= nextBeatTime) {
-      DebugPrint("New beat t=%d\n", now);
-      // attempt to keep beats exactly on sync, if we fall behind, catch up
-      nextBeatTime += beatLength;
-      if (nextBeatTime <= now + nextBeatTime / 2) {
-         nextBeatTime = now + beatLength;
-      }
-      nextFrameTime = now + frameLength;
-      curRoutine->drawOnBeatSync(&frameTiming);
+      // frames restart from the beat
+      nextFrameTime = lastBeatTime;
+      advanceDeadline(&nextFrameTime, framePeriod, now);
 
-#if DEBUG
-      debugTimes.beatCount += 1;
-      debugTimes.beatTime += millis() - now;
-      DebugPrint("Timing: %d beats avg %d ms; %d frames avg %d ms",
-                 debugTimes.beatCount, debugTimes.beatTime / debugTimes.beatCount,
-                 debugTimes.frameCount, debugTimes.frameTime / debugTimes.frameCount);
-      if (debugTimes.tweenCount) {
-         DebugPrint("; %d tweens avg %d ms",
-                    debugTimes.tweenCount, debugTimes.tweenTime / debugTimes.tweenCount);
-      }
-      Serial.print("\n");
-#endif
+      getFrameTiming(&frameTiming, now);
+      uint32_t start = micros();
+      curRoutine->drawOnBeatSync(&frameTiming);
+      profiler.record(PROFILE_BEAT, micros() - start);
 
       // for debugging/monitoring, blink internal LED at frame rate
       blink = !blink;
       digitalWrite(builtinLedPin, blink ? HIGH : LOW);
-   } else if (now >= nextFrameTime) {
+   } else if (DEADLINE_REACHED(nextFrameTime, now)) {
       // When the inter-frame time elapses, tell current scene to draw a new frame
-      // DebugPrint("New frame t=%ld\n", now);
-      nextFrameTime = now + frameLength;
+      uint32_t deadline = nextFrameTime;
+      uint32_t missed = advanceDeadline(&nextFrameTime, framePeriod, now);
+      profiler.record(PROFILE_FRAME_LATE, now - deadline - missed * framePeriod);
+      profiler.recordDropped(PROFILE_FRAME_LATE, missed);
+
+      getFrameTiming(&frameTiming, now);
+      lastFrameTime = now;
+      framesStarted = true;
+      uint32_t start = micros();
       curRoutine->drawOnFrameSync(&frameTiming);
-#if DEBUG
-      debugTimes.frameCount += 1;
-      debugTimes.frameTime += millis() - now;
-#endif
+      uint32_t drawMicros = micros() - start;
+      profiler.record(PROFILE_FRAME, drawMicros);
+      measureFrame(drawMicros);
    } else {
       // otherwise, spend the time till the next frame letting the draw routine
       // diddle around
+      getFrameTiming(&frameTiming, now);
+      uint32_t start = micros();
       bool used = curRoutine->drawBetweenFrames(&frameTiming);
-#if DEBUG
       if (used) {
-         debugTimes.tweenCount += 1;
-         debugTimes.tweenTime += millis() - now;
+         // routines that draw here (Plasma) are paced by it too
+         uint32_t drawMicros = micros() - start;
+         profiler.record(PROFILE_TWEEN, drawMicros);
+         measureFrame(drawMicros);
+      } else {
+         // Background work (Swirl's map, Spectrum's FFT) presents nothing,
+         // so it mustn't set the pace as a frame would; and the LEDs still
+         // want the current frame resent to dither it, if it has anything
+         // between output levels (refresh() knows).
+         if (curRoutine->workBetweenFrames(&frameTiming)) {
+            profiler.record(PROFILE_WORK, micros() - start);
+         }
+         fb.refresh();
+      }
+
+      // the microphone, if any, which keeps the beat when nobody's tapping
+      start = micros();
+      if (audio.process()) {
+         profiler.record(PROFILE_AUDIO, micros() - start);
+      }
+
+      // and catch up on reporting
+      profiler.flush();
+      telemetryDrain();
+   }
+}
+
+
+uint32_t Scene::advanceDeadline(uint32_t *deadline, uint32_t period, uint32_t now) {
+   uint32_t missed = (now - *deadline) / period;
+   *deadline += (missed + 1) * period;
+   return missed;
+}
+
+
+void Scene::getFrameTiming(FrameTimingInfo *frameTiming, uint32_t now) {
+   uint32_t sinceBeat = now - lastBeatTime;
+   uint32_t beatMicros = nextBeatTime - lastBeatTime; // this one, slewing included
+
+   frameTiming->beatLength = beatLength;
+   frameTiming->beatRelative = sinceBeat / 1000;
+   frameTiming->beatPhase = sinceBeat < beatMicros ? ((uint64_t)sinceBeat << 16) / beatMicros : 0xFFFF;
+   frameTiming->elapsed = framesStarted ? min(now - lastFrameTime, maxElapsed) : 0;
+   frameTiming->time = millis() - routineStart;
+}
+
+
+void Scene::measureFrame(uint32_t micros) {
+   // follow a slower frame at once, a faster one gradually, so the odd
+   // expensive frame (a routine that only redraws every so often) sets the pace
+   if (micros > renderMicros) {
+      renderMicros = micros;
+   } else {
+      renderMicros -= (renderMicros - micros) / 16;
+   }
+
+   // no point drawing frames faster than the LEDs can take them
+   framePeriod = max(renderMicros + idleMicros, (uint32_t)fb.transmitMicros);
+   profiler.deadlineMicros = framePeriod;
+
+   governQuality();
+}
+
+
+void Scene::governQuality() {
+   unsigned long now = millis();
+
+   if (renderMicros > frameBudget) {
+      // over budget: drop a level at once
+      if (qualityLevel < numQualityLevels - 1) {
+         setQualityLevel(qualityLevel + 1);
+         qualityWasDropped = true;
+      }
+   } else if (renderMicros < frameBudget / 2 && qualityLevel > 0) {
+      // plenty of room: try the next level up, though not for a while if
+      // that's the one we just dropped from, or we'd go back and forth
+      unsigned long hold = qualityWasDropped ? qualityRetryLength : qualityHoldLength;
+      if (now - qualityChanged > hold) {
+         setQualityLevel(qualityLevel - 1);
+         qualityWasDropped = false;
       }
-#endif
    }
 }
 
 
-void Scene::onButton(Action action, BOOL pressed, int step) {
+void Scene::setQualityLevel(int level) {
+   DebugPrint("Quality level %d (render %lu us)\n", level, renderMicros);
+   const QualityInfo *quality = qualityLevels + level;
+   qualityLevel = level;
+   qualityChanged = millis();
+   profiler.qualityLevel = level;
+
+   fb.setDither(quality->dither);
+   curRoutine->setQuality(quality);
+
+   // what we measured was at the old level; start again
+   renderMicros = 0;
+}
+
+
+void Scene::onGesture(Action action, const Gesture *gesture, int step) {
    switch (action) {
       case ACTION_MODE:
-         if (pressed) {
+         // every click is a step, however quick
+         if (gesture->type != GESTURE_HOLD) {
             DebugPrint("Adjust major mode %d\n", step);
             onChooseNewRoutine(step);
-#if DEBUG
-            memset(&debugTimes, 0, sizeof debugTimes);
-#endif
          }
          break;
 
       case ACTION_PARAM:
-         if (pressed) {
-            DebugPrint("Adjust minor mode %d\n", step);
-            curRoutine->adjustParam(step);
-#if DEBUG
-            memset(&debugTimes, 0, sizeof debugTimes);
-#endif
-         }
+         DebugPrint("Adjust minor mode %d, gesture %d\n", step, gesture->type);
+         curRoutine->onGesture(gesture->type, step);
          break;
 
       case ACTION_SPEED:
-         DebugPrint("Adjust frame time: %s\n", pressed ? "press" : "release");
-         onSetTimer(pressed);
+         if (gesture->type == GESTURE_TAP) {
+            onTap(gesture->time);
+         } else if (gesture->type == GESTURE_HOLD) {
+            // press and hold starts a new beat series, which is easier than
+            // waiting out the latch
+            DebugPrint("Beat timer: press-and-hold reset\n");
+            beatTracker.reset(); // slow down to 2 bps until we get more taps
+            beatLength = beatTracker.period / 1000;
+         }
          break;
    }
 }
@@ -144,68 +254,211 @@ void Scene::onChooseNewRoutine(int step) {
    whichRoutine = (whichRoutine + step + numRoutines) % numRoutines;
    curRoutine = routineTable[whichRoutine];
 
+   // start over at the old pace till we've timed the new one
+   framePeriod = initialFramePeriod;
+   renderMicros = 0;
+   framesStarted = false;
+   routineStart = millis();
+
+   profiler.begin(whichRoutine, routineNames[whichRoutine]);
+   profiler.deadlineMicros = framePeriod;
    curRoutine->begin(stateBuf);
+
+   // and at full quality
+   setQualityLevel(0);
+   qualityWasDropped = false;
 }
 
 
-void Scene::onSetTimer(BOOL pressed) {
-   long now = millis();
+void Scene::onTap(long time) {
+   // the beat clock is in us; date the tap by its age
+   uint32_t tapTime = micros() - (millis() - time) * 1000;
+   uint32_t sinceTap = tapTime - beatTracker.lastTap;
 
-   if (pressed) {
-      // on press, we adjust the current beat series, unless it's been a while
-      // (default 2 seconds) since the previous press, in which case we start
-      // a new beat series. That also implies there's no setting this slower than
-      // 30 bpm.
-      if (now - lastTimerPress > beatTimerLatchLength) {
-         DebugPrint("Beat timer: timeout reset\n");
-         timeSeries.reset(now);
-         beatLength = initialBeatLength; // slow down to 2 bps until we get more taps
+   switch (beatTracker.tap(tapTime, lastBeatTime, nextBeatTime)) {
+      case BeatTracker::TAP_FIRST:
+         // a new series (the first tap, or an off-beat one after 2 seconds
+         // without, which also means there's no setting this slower than
+         // 30 bpm): the beat starts over from this tap
+         DebugPrint("Beat timer: new series\n");
+         nextBeatTime = tapTime;
          curRoutine->startBeatMeasure();
-      } else {
-         // add this data point to time series and take average
-         int newBeatLength = timeSeries.addAndRecalc(now);
-         if (!newBeatLength) {
-            // if this was ignored due to debounce, skip the next-frame-on-press
-            // logic below
-            return;
-         }
-         beatLength = newBeatLength;
-         DebugPrint("Beat interval now %dms\n", beatLength);
+         break;
+
+      case BeatTracker::TAP_SEEDED:
+         // a new tempo, tapped twice: the beat is now, at that pace, but
+         // the measure carries on
+         DebugPrint("Beat interval set to %lu us\n", beatTracker.period);
+         nextBeatTime = tapTime;
+         break;
+
+      case BeatTracker::TAP_LOCKED:
+         DebugPrint("Beat interval now %lu us, grid moving %ld us\n",
+                    beatTracker.period, beatTracker.correction);
+         break;
+
+      case BeatTracker::TAP_MISFIT:
+         DebugPrint("Ignoring tap %lu us after the last good one\n", sinceTap);
+         break;
+   }
+   beatLength = beatTracker.period / 1000;
+}
+
+
+void Scene::onOnset(uint32_t time, int strength) {
+   BeatTracker::TapResult result =
+      beatTracker.hear(time, audio.tempo, strength, lastBeatTime, nextBeatTime);
+   if (result == BeatTracker::TAP_SEEDED) {
+      // as for taps, but the measure doesn't know where it is
+      DebugPrint("Beat interval set to %lu us by ear\n", beatTracker.period);
+      nextBeatTime = time;
+   }
+   beatLength = beatTracker.period / 1000;
+}
+
+
+void BeatTracker::begin(uint32_t initialPeriod) {
+   this->initialPeriod = initialPeriod;
+   reset();
+}
+
+void BeatTracker::reset() {
+   period = initialPeriod;
+   correction = 0;
+   lastTap = 0;
+   lastMisfit = 0;
+   taps = 0;
+   misfits = 0;
+   onBeatStrength = offBeatStrength = 0;
+}
+
+// How far time is from the nearest beat on the grid (positive if after it).
+// The grid has yet to move by any correction still owed, so the trackers
+// below move that toward this, rather than starting over.
+static int32_t phaseErrorOf(uint32_t time, uint32_t lastBeat, uint32_t nextBeat) {
+   int32_t sinceLast = time - lastBeat;
+   int32_t untilNext = nextBeat - time;
+   return abs(sinceLast) <= abs(untilNext) ? sinceLast : -untilNext;
+}
+
+BeatTracker::TapResult BeatTracker::tap(uint32_t time, uint32_t lastBeat, uint32_t nextBeat) {
+   if (taps && (time - lastTap < minPeriod || (misfits && time - lastMisfit < minPeriod))) {
+      // bounce, or a double tap; either way, not a beat
+      return TAP_MISFIT;
+   }
+
+   if (!taps) {
+      return first(time);
+   }
+
+   int32_t phaseError = phaseErrorOf(time, lastBeat, nextBeat);
+   bool fits = abs(phaseError) <= (int32_t)(period / 4);
+
+   uint32_t interval = time - lastTap;
+   if (taps == 1 && interval <= maxPeriod) {
+      // the first interval: the grid was only a guess, so take the
+      // tempo as tapped, from here
+      return seed(time, interval);
+   }
+
+   if (!fits) {
+      if (misfits && time - lastMisfit <= maxPeriod) {
+         // off the grid twice running: the music has changed
+         return seed(time, time - lastMisfit);
       }
+      if (interval > maxPeriod) {
+         // one out of the blue after a pause: the beat is here, and
+         // the tempo we had is still the best guess (two more taps off
+         // it will change it)
+         first(time);
+         taps = 2;
+         return TAP_FIRST;
+      }
+      // a sloppy tap; it doesn't move the grid, and the next is measured
+      // from the last good one
+      misfits++;
+      lastMisfit = time;
+      return TAP_MISFIT;
+   }
 
-      // always start new frame on press
-      // nextFrameTime = nextBeatTime = now;
-      lastTimerPress = now;
-   } else {
-      // on release, if it was held a while (default 750 ms), we start a new beat
-      // series. This gives an easier way to start a new series without waiting 2 sec.
-      if (now - lastTimerPress > beatTimerUnlatchLength) {
-         DebugPrint("Beat timer: press-and-hold reset\n");
-         lastTimerPress = 0; // make the next press look like a fresh one
-         beatLength = initialBeatLength; // slow down to 4 fps until we get more taps
+   // Each interval nudges the period: a running average to begin with, then
+   // a fixed share of the way, so the tempo can still follow the music.
+   // After a pause, the drift over that many beats is worth trusting more.
+   uint32_t beats = max((interval + period / 2) / period, (uint32_t)1);
+   int32_t residual = interval - beats * period;
+   int32_t gain = beats > maxSkippedBeats + 1 ? 2 : min(taps, (int)maxPeriodGain);
+   period += residual / (int32_t)beats / gain;
+   period = constrain(period, (uint32_t)minPeriod, (uint32_t)maxPeriod);
+   correction += (phaseError - correction) >> phaseGainShift;
+
+   taps++;
+   misfits = 0;
+   lastTap = time;
+   return TAP_LOCKED;
+}
+
+BeatTracker::TapResult BeatTracker::hear(uint32_t time, uint32_t tempo, int strength,
+                                         uint32_t lastBeat, uint32_t nextBeat) {
+   if (!tempo || (taps && time - lastTap < tapPriority)) {
+      // no steady beat to follow (talking, noise), or someone's tapping,
+      // and knows better
+      return TAP_MISFIT;
+   }
+
+   tempo = constrain(tempo, (uint32_t)minPeriod, (uint32_t)maxPeriod);
+   int32_t change = tempo - period;
+   if (abs(change) > (int32_t)(period / 8)) {
+      // a new song: start the beat here, and see how it lines up
+      period = tempo;
+      correction = 0;
+      onBeatStrength = offBeatStrength = 0;
+      return TAP_SEEDED;
+   }
+   period += change / 8;
+
+   // Onsets come on the off-beats too, so follow the ones near the beat,
+   // and keep score: if the off-beats are consistently the stronger (the
+   // grid started on a hi-hat), move the grid half a beat.
+   onBeatStrength -= onBeatStrength >> 4;
+   offBeatStrength -= offBeatStrength >> 4;
+   int32_t phaseError = phaseErrorOf(time, lastBeat, nextBeat);
+   if (abs(phaseError) > (int32_t)(period / 4)) {
+      offBeatStrength += strength;
+      if (offBeatStrength > onBeatStrength * 2) {
+         correction = phaseError;
+         int32_t swap = onBeatStrength;
+         onBeatStrength = offBeatStrength;
+         offBeatStrength = swap;
+         return TAP_LOCKED;
       }
+      return TAP_MISFIT;
    }
+   onBeatStrength += strength;
+   correction += (phaseError - correction) >> heardGainShift;
+   return TAP_LOCKED;
 }
 
+BeatTracker::TapResult BeatTracker::first(uint32_t time) {
+   taps = 1;
+   misfits = 0;
+   correction = 0;
+   lastTap = time;
+   return TAP_FIRST;
+}
 
-void TimeSeries::reset(long time) {
-   start = end = time;
-   numPoints = 0;
+BeatTracker::TapResult BeatTracker::seed(uint32_t time, uint32_t interval) {
+   period = constrain(interval, (uint32_t)minPeriod, (uint32_t)maxPeriod);
+   correction = 0;
+   taps = 2;
+   misfits = 0;
+   lastTap = time;
+   return TAP_SEEDED;
 }
 
-int TimeSeries::addAndRecalc(long time) {
-   if (time - end < beatTimerMinimum) {
-      // This is kind of a cheap debounce, but you wouldn't normally expect bounce on
-      // this time scale. Anyway, I was seeing a lot of spurious events around 120 ms
-      // after an intentional press. I can't intentionally tap any faster than ~160 ms
-      // anyway, and even 200 is 300 bpm, so let's ignore faster than that.
-      DebugPrint("ignoring beat pulse %ld ms below threshold %d\n", time - end, beatTimerMinimum);
-      return 0;
-   } else {
-      end = time;
-      numPoints++;
-   }
-   int delta = end - start;
-   DebugPrint("beat rate %d ms from %d ms / %d samples\n", delta / numPoints, delta, numPoints);
-   return delta / numPoints;
+uint32_t BeatTracker::nextBeat(uint32_t lastBeat) {
+   // an eighth of a beat at a time is hard to see
+   int32_t limit = period / 8;
+   int32_t slew = constrain(correction, -limit, limit);
+   correction -= slew;
+   return lastBeat + period + slew;
 }
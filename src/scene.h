@@ -1,15 +1,55 @@
 #pragma once
 
-class TimeSeries {
+/*
+ * Tap tempo, phase-locked. Each tap that lands near where the beat grid
+ * says it should nudges the period toward the tapped interval and the grid
+ * toward the tap, so one sloppy tap costs little and the beat follows the
+ * music instead of drifting off it. Taps that don't fit are ignored, unless
+ * they keep coming, which means the tempo has changed. Onsets heard in the
+ * music (see audio.h) steer it the same way when nobody has tapped lately.
+ * Integer us throughout.
+ */
+class BeatTracker {
 public:
-   void reset(long time);
-   int addAndRecalc(long time);
+   typedef enum {
+      TAP_MISFIT,  // ignored
+      TAP_FIRST,   // of a new series: the beat is now
+      TAP_SEEDED,  // a new tempo: the beat is now, at the tapped period
+      TAP_LOCKED,  // period and phase adjusted
+   } TapResult;
+
+   static const uint32_t minPeriod = 200000;  // us; faster taps are bounce (or sloppy)
+   static const uint32_t maxPeriod = 2000000; // a longer gap is a pause
+   static const int maxSkippedBeats = 3;      // between taps; more is a pause
+   static const int maxPeriodGain = 4;        // period moves at least 1/4 of the way per tap
+   static const int phaseGainShift = 1;       // and the grid 1/2
+   static const int heardGainShift = 2;       // an onset near the beat moves it 1/4
+   static const uint32_t tapPriority = 15000000; // us after a tap that the audio is ignored
 
-   const int beatTimerMinimum = 200; // ignore taps faster than 300 bpm (assume spurious/bounce)
+   void begin(uint32_t initialPeriod);
+   void reset(); // start a new series, at the initial period
+   // lastBeat and nextBeat are the beat grid as scheduled now.
+   TapResult tap(uint32_t time, uint32_t lastBeat, uint32_t nextBeat);
+   // Likewise an onset heard in the music, how strong it was, and the
+   // music's tempo (0 if unsure, when it's ignored); the tempo slews, or
+   // jumps to a new song's.
+   TapResult hear(uint32_t time, uint32_t tempo, int strength,
+                  uint32_t lastBeat, uint32_t nextBeat);
+   // When the beat after lastBeat comes: a period on, plus some of any
+   // correction still owed, so the beat slews into line instead of jumping.
+   uint32_t nextBeat(uint32_t lastBeat);
+   TapResult first(uint32_t time);
+   TapResult seed(uint32_t time, uint32_t interval);
 
-   long start;
-   long end;
-   int numPoints;
+   uint32_t initialPeriod;
+   uint32_t period;    // us
+   int32_t correction; // us the grid still has to move (later, if positive)
+   uint32_t lastTap;   // that fit
+   uint32_t lastMisfit;
+   int taps;           // that fit, in this series
+   int misfits;        // in a row
+   int32_t onBeatStrength;  // of recent onsets heard near the beat
+   int32_t offBeatStrength; // and between beats
 };
 
 
@@ -21,26 +61,58 @@ public:
       ACTION_SPEED
    } Action;
 
-   const int beatTimerLatchLength = 2000;
-   const int beatTimerUnlatchLength = 750;
    const int initialBeatLength = 500; // start at 2 bps == 120 bpm
-   const int frameLength = 33; // ~30 fps for animations
+   const uint32_t initialFramePeriod = 33000; // ~30 fps till we've timed a routine
+   const uint32_t idleMicros = 500; // left over each frame for input, tweens and telemetry
+   const uint32_t maxElapsed = 100000; // longer gaps (a stall, a new routine) count as this
+   const uint32_t frameBudget = 16667; // us; quality drops to keep frames within this
+   const unsigned long qualityHoldLength = 1000; // ms at a level before trying a better one
+   const unsigned long qualityRetryLength = 10000; // ms, if the better one was too slow
+   static const int numQualityLevels = 6;
 
    void begin();
    void loop();
 
-   void onButton(Scene::Action action, BOOL pressed, int step);
+   void onGesture(Scene::Action action, const Gesture *gesture, int step);
    void onChooseNewRoutine(int step);
-   void onSetTimer(BOOL pressed);
+   // time is the press, which may have been a little while ago
+   void onTap(long time);
+   // time (micros()) of an onset in the audio input, see audio.h
+   void onOnset(uint32_t time, int strength);
+
+   // Deadline bookkeeping; returns how many whole periods were missed
+   // (and skipped), and advances *deadline past now.
+   uint32_t advanceDeadline(uint32_t *deadline, uint32_t period, uint32_t now);
+   void getFrameTiming(FrameTimingInfo *frameTiming, uint32_t now);
+   // Fold in how long a frame took to draw and pick the next frame period.
+   void measureFrame(uint32_t micros);
+   // Adjust the quality level to the measured render time.
+   void governQuality();
+   void setQualityLevel(int level);
 
    int whichRoutine;
    Routine *curRoutine;
    BOOL blink;
-   long nextFrameTime;
-   long nextBeatTime;
-   int beatLength;
 
-   // state for timer-rate tracking
-   long lastTimerPress;
-   TimeSeries timeSeries;
+   // schedule, as absolute micros() deadlines: frames are on a grid that
+   // starts at each beat
+   uint32_t lastBeatTime;
+   uint32_t nextBeatTime;
+   uint32_t nextFrameTime;
+   int beatLength; // ms, the beat tracker's period, for the routines
+
+   // frame rate: as fast as the current routine can draw and the LEDs can
+   // take its frames
+   uint32_t framePeriod;    // us
+   uint32_t renderMicros;   // recent drawOnFrameSync time, including show
+   uint32_t lastFrameTime;  // when the previous drawOnFrameSync was called
+   bool framesStarted;      // whether there's been one yet for this routine
+   unsigned long routineStart; // millis()
+
+   // quality governor, over qualityLevels[] in scene.cpp
+   int qualityLevel;
+   unsigned long qualityChanged; // millis()
+   bool qualityWasDropped; // whether we got to this level by dropping from a better one
+
+   BeatTracker beatTracker;
 };
@@ -0,0 +1,193 @@
+#include <Arduino.h>
+#include "defs.h"
+#include "routine.h"
+#include "framebuffer.h"
+#include "raster.h"
+#include "audio.h"
+
+extern Framebuffer fb;
+
+
+static const int displayRange = 12 * 32; // 1/32 octaves of energy from floor to top: 36 dB
+static const int minTop = 20 * 32;       // so silence (and rounding noise) stays dark
+static const int fallRate = 24;          // pixels per second, bars
+static const int peakFallRate = 6;       // and the peak marks
+
+
+static int bitReverse(int i, int bits) {
+   int r = 0;
+   for (int b = 0; b < bits; b++, i >>= 1) {
+      r = (r << 1) | (i & 1);
+   }
+   return r;
+}
+
+// low green through yellow to red at the top, with y out of height
+static int barColor(int y, int height) {
+   int frac = y * 512 / height;
+   return (min(frac, 255) << 16) | (min(512 - frac, 255) << 8);
+}
+
+// black through blue and red to yellow, with level 0 - 256
+static int heatColor(int level) {
+   int r = constrain(level * 2 - 128, 0, 255);
+   int g = constrain(level * 2 - 320, 0, 255);
+   int b = level < 128 ? level * 2 : max(0, 511 - level * 2);
+   return (r << 16) | (g << 8) | b;
+}
+
+
+void SpectrumRoutine::begin(void *stateBuf) {
+   static_assert(sizeof(Data) < ROUTINE_STATEBUF_SIZE, "buffer overflow");
+   data = (Data *) stateBuf;
+   memset(data, 0, sizeof *data);
+   data->top = minTop * 16;
+
+   // Bands spaced evenly in pitch, from the lowest bin to the highest, at
+   // least one bin each; with fewer bins than columns at the bottom, wider
+   // columns would look odd, so the columns share bands instead.
+   data->numBars = min(fb.width, (int)maxBars);
+   int lastBin = fftSize / 2;
+   data->bandStart[0] = 1;
+   for (int b = 1; b <= data->numBars; b++) {
+      int bin = round(pow(lastBin, float(b) / data->numBars));
+      data->bandStart[b] = constrain(bin, data->bandStart[b - 1] + 1, lastBin);
+   }
+}
+
+void SpectrumRoutine::adjustParam(int step) {
+   data->mode = (data->mode + step + NUM_MODES) % NUM_MODES;
+   fb.clearScreen();
+}
+
+
+bool SpectrumRoutine::workBetweenFrames(FrameTimingInfo *frameTiming) {
+   // The pipeline is a few steps of some us each; take as many as fit in
+   // the budget, so the next frame never has to wait on it.
+   // (tools/host/bench_spectrum times them.)
+   uint32_t start = micros();
+   bool worked = false;
+   do {
+      if (!step()) {
+         break;
+      }
+      worked = true;
+   } while (micros() - start < stepBudgetMicros);
+   return worked;
+}
+
+bool SpectrumRoutine::step() {
+   if (data->stage == 0) {
+      if ((int32_t)(audio.samplesIn - data->nextBlock) < 0) {
+         return false;
+      }
+      data->nextBlock = audio.samplesIn + blockHop;
+      loadBlock();
+   } else if (data->stage <= fftStages) {
+      butterflies(data->stage);
+   } else {
+      measureBands();
+      data->stage = 0;
+      return true;
+   }
+   data->stage++;
+   return true;
+}
+
+void SpectrumRoutine::loadBlock() {
+   // Hann window, into bit-reversed order for the FFT
+   int16_t samples[fftSize];
+   audio.getRecent(samples, fftSize);
+   for (int i = 0; i < fftSize; i++) {
+      int window = (16384 - fixedCos(i * (0x10000 / fftSize))) >> 1; // 1 << 14 at the middle
+      int j = bitReverse(i, fftStages);
+      data->re[j] = (samples[i] * window) >> 14;
+      data->im[j] = 0;
+   }
+}
+
+void SpectrumRoutine::butterflies(int stage) {
+   // Radix 2, decimation in time. Each stage halves the results, which
+   // keeps them in 16 bits at full scale.
+   int half = 1 << (stage - 1);
+   int span = half * 2;
+   for (int j = 0; j < half; j++) {
+      uint16_t angle = j * (0x10000 / span);
+      int wr = fixedCos(angle);
+      int wi = -fixedSin(angle);
+      for (int k = j; k < fftSize; k += span) {
+         int16_t *re = data->re, *im = data->im;
+         int tr = (wr * re[k + half] - wi * im[k + half]) >> 14;
+         int ti = (wr * im[k + half] + wi * re[k + half]) >> 14;
+         re[k + half] = (re[k] - tr) >> 1;
+         im[k + half] = (im[k] - ti) >> 1;
+         re[k] = (re[k] + tr) >> 1;
+         im[k] = (im[k] + ti) >> 1;
+      }
+   }
+}
+
+void SpectrumRoutine::measureBands() {
+   int loudest = 0;
+   for (int b = 0; b < data->numBars; b++) {
+      uint32_t power = 0;
+      for (int k = data->bandStart[b]; k < data->bandStart[b + 1]; k++) {
+         power += data->re[k] * data->re[k] + data->im[k] * data->im[k];
+      }
+      data->level[b] = logEnergy(power);
+      loudest = max(loudest, (int)data->level[b]);
+   }
+
+   // the loudest band sets the top of the scale at once, and lets it down
+   // slowly (~1 dB/s), so the bars fill the screen whatever the volume
+   if (loudest * 16 > data->top) {
+      data->top = loudest * 16;
+   } else if (data->top > minTop * 16) {
+      data->top--;
+   }
+}
+
+int SpectrumRoutine::barHeight(int level) {
+   int floor = data->top / 16 - displayRange;
+   return constrain((level - floor) * fb.height * 256 / displayRange, 0, fb.height * 256);
+}
+
+
+void SpectrumRoutine::drawOnFrameSync(FrameTimingInfo *frameTiming) {
+   // bars jump up and fall back
+   int fall = data->fallTimer.perSecond(frameTiming, fallRate * 256);
+   int peakFall = data->peakFallTimer.perSecond(frameTiming, peakFallRate * 256);
+   for (int b = 0; b < data->numBars; b++) {
+      int target = barHeight(data->level[b]);
+      data->shown[b] = max(target, data->shown[b] - fall);
+      data->peak[b] = max((int)data->shown[b], data->peak[b] - peakFall);
+   }
+
+   if (data->mode == MODE_SPECTROGRAM) {
+      // a row at a time, down the screen
+      for (int n = data->rowTimer.steps(frameTiming, rowMicros); n; n--) {
+         for (int y = 0; y < fb.height - 1; y++) {
+            for (int x = 0; x < fb.width; x++) {
+               fb.setGridPixel(x, y, fb.getGridPixel(x, y + 1));
+            }
+         }
+         for (int x = 0; x < fb.width; x++) {
+            int b = x * data->numBars / fb.width;
+            fb.setGridPixel(x, fb.height - 1, heatColor(data->shown[b] / fb.height));
+         }
+      }
+   } else {
+      for (int x = 0; x < fb.width; x++) {
+         int b = x * data->numBars / fb.width;
+         int height = data->shown[b] >> 8;
+         for (int y = 0; y < height; y++) {
+            fb.setGridPixel(x, y, barColor(y, fb.height));
+         }
+         fb.fillColumnSpan(x, height, fb.height - 1, 0);
+         if (data->mode == MODE_PEAKS) {
+            fb.setGridPixel(x, min(data->peak[b] >> 8, fb.height - 1), 0x808080);
+         }
+      }
+   }
+   fb.showWithLimit();
+}
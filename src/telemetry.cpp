@@ -0,0 +1,64 @@
+#include <Arduino.h>
+#include "defs.h"
+#include "telemetry.h"
+
+
+/*
+ * Records are queued in a ring and written out from idle time, so sending
+ * one costs a copy, never a wait on the USB host.
+ */
+static const int ringSize = 1024; // power of 2
+static uint8_t ring[ringSize];
+static volatile uint16_t ringHead = 0; // next byte to write
+static volatile uint16_t ringTail = 0; // next byte to send
+
+unsigned long telemetryDropped = 0;
+
+static inline void ringPut(uint16_t *head, uint8_t byte) {
+   ring[*head] = byte;
+   *head = (*head + 1) & (ringSize - 1);
+}
+
+bool telemetrySend(TelemetryType type, const void *payload, int length) {
+#if DEBUG
+   const uint8_t *bytes = (const uint8_t *)payload;
+   uint16_t head = ringHead;
+   int used = (head - ringTail) & (ringSize - 1);
+   if (ringSize - 1 - used < length + 4) {
+      telemetryDropped++;
+      return false;
+   }
+
+   uint8_t checksum = 0;
+   ringPut(&head, TELEMETRY_SYNC);
+   ringPut(&head, type);
+   ringPut(&head, length);
+   for (int i = 0; i < length; i++) {
+      ringPut(&head, bytes[i]);
+      checksum ^= bytes[i];
+   }
+   ringPut(&head, checksum);
+
+   // publish the whole record at once
+   ringHead = head;
+   return true;
+#else
+   return false;
+#endif
+}
+
+void telemetryDrain() {
+#if DEBUG
+   while (ringTail != ringHead) {
+      int room = Serial.availableForWrite();
+      if (room <= 0) {
+         break;
+      }
+      uint16_t tail = ringTail;
+      int contiguous = (ringHead > tail ? ringHead : ringSize) - tail;
+      int n = min(room, contiguous);
+      Serial.write(ring + tail, n);
+      ringTail = (tail + n) & (ringSize - 1);
+   }
+#endif
+}
@@ -0,0 +1,76 @@
+/*
+ * telemetry.h
+ *
+ * Binary records sent over the serial port, for tools/telemetry.py to
+ * decode on the host. Each record is
+ *
+ *    TELEMETRY_SYNC, type, payload length, payload..., checksum
+ *
+ * where the checksum is the xor of the payload bytes. Multi-byte fields are
+ * little-endian (native on the Teensy). Plain text can share the port: it's
+ * all ASCII, so never looks like TELEMETRY_SYNC.
+ */
+
+#pragma once
+
+#include <stdint.h>
+
+static const uint8_t TELEMETRY_SYNC = 0xA5;
+
+typedef enum {
+   TELEMETRY_ROUTINE = 1,   // TelemetryRoutine
+   TELEMETRY_HISTOGRAM = 2, // TelemetryHistogram
+   TELEMETRY_FB_STATS = 3,  // TelemetryFbStats
+   TELEMETRY_LOG_FORMAT = 4, // TelemetryLogFormat
+   TELEMETRY_LOG = 5,       // DebugLogRecord (see debuglog.h), up to its args
+} TelemetryType;
+
+// Now profiling routine index, named name[] (not terminated)
+typedef struct {
+   uint8_t index;
+   char name[31];
+} TelemetryRoutine;
+
+// Latency of one routine callback since the last record for it, in us;
+// see LatencyHistogram in profile.h for the bucket boundaries.
+typedef struct {
+   uint8_t routine;
+   uint8_t callback;   // ProfileCallback
+   uint16_t misses;    // took longer than a frame
+   uint32_t count;
+   uint32_t min;
+   uint32_t max;
+   uint32_t dropped;   // deadlines skipped (PROFILE_*_LATE)
+   uint16_t buckets[64];
+} TelemetryHistogram;
+
+// Framebuffer counters since the last record
+typedef struct {
+   uint32_t time;      // ms
+   int32_t milliamps;  // last frame
+   uint32_t framesSent;
+   uint32_t framesSkipped;
+   uint32_t framesDropped;
+   uint32_t rowsEncoded;
+   uint32_t refreshes;
+   uint32_t refreshMicros;
+   uint32_t framePeriod; // us, what the scene is aiming for now
+   int32_t qualityLevel; // likewise, see Scene::governQuality
+} TelemetryFbStats;
+
+// The text of a DebugPrint format, sent before its first message; format
+// is its address, which the messages refer to it by. Text not terminated.
+typedef struct {
+   uint32_t format;
+   char text[251];
+} TelemetryLogFormat;
+
+// Queue one record; returns false (and counts it in telemetryDropped) if
+// there isn't room. Nothing is written to the port until telemetryDrain().
+bool telemetrySend(TelemetryType type, const void *payload, int length);
+
+// Write as much of the queue as the serial port will take without
+// blocking; call in idle time.
+void telemetryDrain();
+
+extern unsigned long telemetryDropped;
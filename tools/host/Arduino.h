@@ -0,0 +1,75 @@
+/*
+ * Arduino.h, for the host build (see Makefile): just what the dreamcoat
+ * uses of the Teensyduino core, with the clock, pins and interrupts
+ * driven from host.h.
+ */
+
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <algorithm>
+
+typedef uint8_t byte;
+
+#define PROGMEM
+#define DMAMEM
+#define pgm_read_byte_near(p) (*(const uint8_t *)(p))
+#define pgm_read_word_near(p) (*(const uint16_t *)(p))
+
+#define HIGH 1
+#define LOW 0
+#define INPUT 0
+#define OUTPUT 1
+#define INPUT_PULLUP 2
+#define CHANGE 4
+
+#define F_CPU 96000000
+
+using std::min;
+using std::max;
+#define constrain(amt, low, high) ((amt) < (low) ? (low) : ((amt) > (high) ? (high) : (amt)))
+
+unsigned long millis();
+unsigned long micros();
+void delayMicroseconds(unsigned int us);
+
+long random(long howBig);
+long random(long howSmall, long howBig);
+void randomSeed(unsigned long seed);
+
+void pinMode(int pin, int mode);
+int digitalRead(int pin);
+void digitalWrite(int pin, int value);
+int analogRead(int pin);
+void analogReadResolution(int bits);
+void analogReadAveraging(int samples);
+
+int digitalPinToInterrupt(int pin);
+void attachInterrupt(int interrupt, void (*handler)(), int mode);
+static inline void __disable_irq() {}
+static inline void __enable_irq() {}
+#define noInterrupts() __disable_irq()
+#define interrupts() __enable_irq()
+
+class IntervalTimer {
+public:
+   bool begin(void (*handler)(), unsigned int micros);
+   void end();
+   void priority(uint8_t priority) {}
+};
+
+// telemetry goes nowhere
+class HostSerial {
+public:
+   void begin(long baud) {}
+   int availableForWrite() { return 64; }
+   size_t write(const uint8_t *buffer, size_t size) { return size; }
+   size_t write(uint8_t b) { return 1; }
+   operator bool() { return true; }
+};
+extern HostSerial Serial;
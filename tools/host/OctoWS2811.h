@@ -0,0 +1,66 @@
+/*
+ * OctoWS2811.h, for the host build: no LEDs, but show() keeps them busy
+ * for as long as the real DMA transfer would take, by the host clock, so
+ * the scene's pacing sees the same limits it would on the Teensy.
+ *
+ * setPixel is the library's own, bit for bit, so what the Framebuffer
+ * encodes can be checked against it.
+ */
+
+#pragma once
+
+#include <stdint.h>
+
+#define WS2811_RGB 0
+#define WS2811_RBG 1
+#define WS2811_GRB 2
+#define WS2811_800kHz 0x00
+
+unsigned long micros();
+extern bool hostInstantLeds; // see host.h
+
+class OctoWS2811 {
+public:
+   OctoWS2811(uint32_t numPerStrip, void *frameBuf, void *drawBuf, uint8_t config = WS2811_GRB)
+      : stripLen(numPerStrip), shows(0), lastShow(0), drawBuffer(drawBuf), params(config) {}
+
+   void begin() {}
+   // the Framebuffer only calls this once they're free
+   void show() {
+      lastShow = micros();
+      shows++;
+   }
+   // one byte per bit of the color, most significant first, holding that
+   // bit for all 8 strips
+   void setPixel(uint32_t num, int color) {
+      switch (params & 7) {
+         case WS2811_RBG:
+            color = (color & 0xFF0000) | ((color << 8) & 0x00FF00) | ((color >> 8) & 0x0000FF);
+            break;
+         case WS2811_GRB:
+            color = ((color << 8) & 0xFF0000) | ((color >> 8) & 0x00FF00) | (color & 0x0000FF);
+            break;
+      }
+      uint32_t strip = num / stripLen;
+      uint32_t offset = num % stripLen;
+      uint8_t bit = 1 << strip;
+      uint8_t *p = (uint8_t *)drawBuffer + offset * 24;
+      for (uint32_t mask = 1 << 23; mask; mask >>= 1) {
+         if (color & mask) {
+            *p++ |= bit;
+         } else {
+            *p++ &= ~bit;
+         }
+      }
+   }
+   int busy() {
+      // 24 bits at 800 kHz per LED, all strips in parallel, then the latch
+      return !hostInstantLeds && shows && micros() - lastShow < stripLen * 30 + 300;
+   }
+
+   uint32_t stripLen;
+   uint32_t shows;
+   uint32_t lastShow;
+   void *drawBuffer;
+   uint8_t params;
+};
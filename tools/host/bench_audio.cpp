@@ -0,0 +1,122 @@
+/*
+ * The beat detector (audio.h) on WAV files: what it costs per second of
+ * audio, and how well the beat clock follows the music.
+ *
+ * usage: bench_audio file.wav bpm [file.wav bpm ...]
+ *
+ * cost: AudioInput::process on the whole file, as fast as it'll go.
+ *
+ * tracking: the real Scene, with the file played in on the simulated
+ * clock as the ADC would; over the second half, the tempo the detector
+ * heard, the beat clock's period, and how far its beats were from the
+ * file's (which make_click_wav.py puts clickOffset in, then every beat).
+ */
+
+#include <Arduino.h>
+#include "defs.h"
+#include "routine.h"
+#include "scene.h"
+#include "framebuffer.h"
+#include "control_pad.h"
+#include "audio.h"
+#include "platform.h"
+#include "host.h"
+#include "wav_source.h"
+
+extern Scene scene;
+
+static const uint32_t clickOffset = 137000; // us, make_click_wav.py's default
+static const uint32_t loopMicros = 500;     // simulated time per pass of the loop
+
+
+static void start() {
+   fb.begin();
+   controls.begin(CONTROL_MAJMODE_PREV_PIN, CONTROL_MAJMODE_NEXT_PIN,
+                  CONTROL_MINMODE_PREV_PIN, CONTROL_MINMODE_NEXT_PIN,
+                  CONTROL_SPEED_PIN, CONTROL_NEEDS_PULLUP);
+   scene.begin();
+}
+
+
+// us of processing per second of audio
+static double timeProcessing(WavAudioSource *wav) {
+   hostRealClock();
+   start();
+   audio.begin(wav);
+   wav->play(false);
+   uint64_t before = hostNanos();
+   while (!wav->finished()) {
+      audio.process();
+   }
+   return (hostNanos() - before) / 1000.0 / (wav->duration() / 1e6);
+}
+
+
+typedef struct {
+   double heardBpm;   // the detector's tempo at the end; 0 if unsure
+   double beatBpm;    // the beat clock's
+   double phaseError; // mean distance of its beats from the file's, ms
+   int beats;
+} Tracking;
+
+static void track(WavAudioSource *wav, uint32_t period, Tracking *result) {
+   uint32_t t0 = 1000000;
+   hostSimulateClock(t0);
+   start();
+   audio.begin(wav);
+   wav->play(true);
+
+   uint32_t half = wav->duration() / 2;
+   uint32_t lastBeat = scene.lastBeatTime;
+   double errorSum = 0;
+   result->beats = 0;
+   while (!wav->finished()) {
+      scene.loop();
+      if (scene.lastBeatTime != lastBeat) {
+         lastBeat = scene.lastBeatTime;
+         uint32_t at = lastBeat - t0;
+         if (at >= half) {
+            // from the nearest of the file's beats
+            int32_t off = (int32_t)((at - clickOffset) % period);
+            if (off > (int32_t)period / 2) {
+               off -= period;
+            }
+            errorSum += abs(off) / 1000.0;
+            result->beats++;
+         }
+      }
+      hostAdvanceClock(loopMicros);
+   }
+
+   result->heardBpm = audio.tempo ? 60e6 / audio.tempo : 0;
+   result->beatBpm = 60e6 / scene.beatTracker.period;
+   result->phaseError = result->beats ? errorSum / result->beats : 0;
+}
+
+
+int main(int argc, char **argv) {
+   if (argc < 3 || argc % 2 != 1) {
+      fprintf(stderr, "usage: %s file.wav bpm [file.wav bpm ...]\n", argv[0]);
+      return 2;
+   }
+
+   printf("%-24s %6s | %12s %10s | %8s %8s %10s %6s\n", "file", "bpm", "us/s audio",
+          "ns/sample", "heard", "beat", "phase ms", "beats");
+   for (int i = 1; i < argc; i += 2) {
+      WavAudioSource wav;
+      if (!wav.open(argv[i])) {
+         return 1;
+      }
+      double bpm = atof(argv[i + 1]);
+
+      double cost = timeProcessing(&wav);
+      Tracking tracking;
+      track(&wav, 60e6 / bpm, &tracking);
+
+      const char *name = strrchr(argv[i], '/') ? strrchr(argv[i], '/') + 1 : argv[i];
+      printf("%-24s %6.1f | %12.1f %10.1f | %8.1f %8.1f %10.1f %6d\n", name, bpm,
+             cost, cost * 1000 / wav.sampleRate, tracking.heardBpm, tracking.beatBpm,
+             tracking.phaseError, tracking.beats);
+   }
+   return 0;
+}
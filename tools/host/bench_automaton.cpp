@@ -0,0 +1,42 @@
+/*
+ * CellularAutomaton (automaton.h): generations a second, per million
+ * cells, for each rule, on a grid far bigger than any coat's so it's the
+ * word kernels being timed and not the edges.
+ */
+
+#include <Arduino.h>
+#include "defs.h"
+#include "framebuffer.h"
+#include "automaton.h"
+#include "host.h"
+
+static const int width = 1024;
+static const int height = 1024;
+static const uint32_t timeMicros = 500000; // per rule
+static uint32_t storage[CellularAutomaton::storageWords(width, height)];
+
+static const char *ruleNames[CellularAutomaton::NUM_RULES] = { "life", "brain", "cyclic" };
+
+
+int main() {
+   randomSeed(1);
+
+   printf("%dx%d grid\n", width, height);
+   printf("%-8s %12s %20s\n", "rule", "us/gen", "gens/s per megacell");
+   for (int rule = 0; rule < CellularAutomaton::NUM_RULES; rule++) {
+      CellularAutomaton ca;
+      ca.begin(storage, width, height, (CellularAutomaton::Rule)rule);
+      ca.seed(rule == CellularAutomaton::RULE_CYCLIC ? 256 : 80);
+
+      int generations = 0;
+      uint64_t start = hostNanos();
+      while (hostNanos() - start < timeMicros * 1000ull) {
+         ca.step();
+         generations++;
+      }
+      double perGeneration = (hostNanos() - start) / 1000.0 / generations;
+      printf("%-8s %12.1f %20.1f\n", ruleNames[rule], perGeneration,
+             1e6 / perGeneration * (width * height / 1e6));
+   }
+   return 0;
+}
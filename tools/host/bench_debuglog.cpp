@@ -0,0 +1,92 @@
+/*
+ * What a debugLog call (debuglog.h) costs the code that makes it: ns per
+ * call, typical and near worst, for each kind of argument; for a format's first
+ * use, when its text goes out too; and with the telemetry ring full, when
+ * the record is dropped.
+ *
+ * Each call is timed on its own, less what timing nothing costs, and the
+ * ring is drained between calls (not timed), as idle time would. The bound
+ * is the 99.9th percentile: the very worst is whenever the host's scheduler
+ * looked away.
+ */
+
+#include <Arduino.h>
+#include <algorithm>
+#include "defs.h"
+#include "debuglog.h"
+#include "telemetry.h"
+#include "host.h"
+
+static const int calls = 200000; // per measurement
+static const int numFormats = 64; // more than the sent-format set holds
+
+static char formats[numFormats][32];
+static uint32_t times[calls];
+
+
+typedef enum { NO_ARGS, INT, THREE_INTS, STRING, FLOAT, FIRST_USE, RING_FULL } Case;
+
+static void logOne(Case c, int i) {
+   switch (c) {
+      case NO_ARGS: debugLog("Beat timer: new series\n"); break;
+      case INT: debugLog("Beat interval set to %lu us\n", (unsigned long)i); break;
+      case THREE_INTS: debugLog("tap %d: %d us, phase %d\n", i, i * 3, -i); break;
+      case STRING: debugLog("routine %s\n", "TranslucentSquares"); break;
+      case FLOAT: debugLog("scale %f\n", i * 0.001); break;
+      case FIRST_USE: debugLog(formats[i % numFormats], i); break;
+      case RING_FULL: debugLog("Beat interval set to %lu us\n", (unsigned long)i); break;
+   }
+}
+
+// ns a call: mean and 99.9th percentile
+static void timeCalls(Case c, double overhead, double *mean, double *bound) {
+   uint64_t total = 0;
+   telemetryDrain();
+   if (c == RING_FULL) {
+      while (telemetrySend(TELEMETRY_LOG, "x", 1)) {
+      }
+   }
+   unsigned long dropped = telemetryDropped;
+   for (int i = 0; i < calls; i++) {
+      uint64_t start = hostNanos();
+      logOne(c, i);
+      uint64_t spent = hostNanos() - start;
+      total += spent;
+      times[i] = spent;
+      if (c != RING_FULL) {
+         telemetryDrain();
+      }
+   }
+   if ((telemetryDropped != dropped) != (c == RING_FULL)) {
+      printf("%lu records dropped\n", telemetryDropped - dropped);
+   }
+   uint32_t *nth = times + calls - calls / 1000;
+   std::nth_element(times, nth, times + calls);
+   *mean = total / (double)calls - overhead;
+   *bound = *nth - overhead;
+}
+
+
+int main() {
+   for (int f = 0; f < numFormats; f++) {
+      snprintf(formats[f], sizeof formats[f], "format %d: %%d\n", f);
+   }
+
+   // what timing costs, with nothing in between
+   uint64_t total = 0;
+   for (int i = 0; i < calls; i++) {
+      uint64_t start = hostNanos();
+      total += hostNanos() - start;
+   }
+   double overhead = total / (double)calls;
+
+   printf("ns a call    %8s %8s\n", "mean", "99.9%");
+   const char *names[] = { "no args", "int", "3 ints", "string", "float", "first use", "ring full" };
+   for (int c = NO_ARGS; c <= RING_FULL; c++) {
+      double mean, bound;
+      timeCalls((Case)c, overhead, &mean, &bound);
+      printf("%-12s %8.1f %8.1f\n", names[c], mean, bound);
+   }
+   telemetryDrain();
+   return 0;
+}
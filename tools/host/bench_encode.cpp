@@ -0,0 +1,132 @@
+/*
+ * Encoding a frame for OctoWS2811, before and after it went into one pass
+ * at show(): the old way, leds.setPixel for every LED as it was drawn
+ * (kept here, in the stub, as the library has it), against fb.show() of a
+ * frame where every row has changed.
+ *
+ * The new pass also puts each channel through the gamma curve and the
+ * dither, and with deep color (the -8bit builds are without; see Makefile)
+ * interpolates the curve on the bits below 8: so it's timed with the dither
+ * on and off, and so is a dither refresh, which re-encodes the whole frame.
+ * (Turning the dither off at run time, as here, is what FB_DITHER off comes
+ * to: the thresholds are all the middle one.)
+ *
+ * Then the check that the one pass puts the bits where setPixel would: a
+ * random frame, not dithered, against the same colors (through the same
+ * gamma curve) set one LED at a time.
+ */
+
+#include <Arduino.h>
+#include <OctoWS2811.h>
+#include "defs.h"
+#include "framebuffer.h"
+#include "platform.h"
+#include "host.h"
+
+extern int drawingMemory[];
+
+static const uint32_t timeMicros = 200000; // per measurement
+static const int numLeds = FB_PHYSICAL_HEIGHT * 8;
+
+static int frames[2][FB_VIRTUAL_WIDTH * FB_VIRTUAL_HEIGHT];
+static int setPixelMemory[FB_PHYSICAL_HEIGHT * 6];
+
+
+static void drawFrame(const int *frame) {
+   for (int y = 0; y < fb.height; y++) {
+      for (int x = 0; x < fb.width; x++) {
+         fb.setGridPixel(x, y, frame[y * fb.width + x]);
+      }
+   }
+}
+
+// us a frame shown, with every row changed; only the show is timed
+static double timeShow(bool dither) {
+   fb.setDither(dither);
+   uint64_t spent = 0;
+   int rounds = 0;
+   while (spent < timeMicros * 1000ull) {
+      drawFrame(frames[rounds & 1]);
+      uint64_t begin = hostNanos();
+      fb.show();
+      spent += hostNanos() - begin;
+      rounds++;
+   }
+   return spent / 1000.0 / rounds;
+}
+
+// us a dither refresh
+static double timeRefresh() {
+   fb.setDither(true);
+   int rounds = 0;
+   uint64_t start = hostNanos();
+   while (hostNanos() - start < timeMicros * 1000ull) {
+      fb.refresh();
+      rounds++;
+   }
+   return (hostNanos() - start) / 1000.0 / rounds;
+}
+
+// the output stage, worked out the long way: gamma, rounded to 8 bits
+static int outputColor(int color) {
+   int out = 0;
+   for (int shift = 0; shift < 24; shift += 8) {
+      int c = (color >> shift) & 0xFF;
+      uint32_t value = 0xFF00 * powf(c / 255.0f, FB_GAMMA) + 0.5f;
+      out |= ((value + 0x80) >> 8) << shift;
+   }
+   return out;
+}
+
+
+int main() {
+   randomSeed(1);
+   fb.begin();
+   hostInstantLeds = true;
+   for (int f = 0; f < 2; f++) {
+      for (int i = 0; i < fb.width * fb.height; i++) {
+         frames[f][i] = fb.randomColor();
+      }
+   }
+   OctoWS2811 byPixel(fb.ledsPerStrip, 0, setPixelMemory, WS2811_GRB);
+   printf("%dx%d grid, %d LEDs a strip, %s color\n", fb.width, fb.height, fb.ledsPerStrip,
+          FB_DEEP_COLOR ? "deep" : "8-bit");
+
+   // before: setPixel per LED
+   int rounds = 0;
+   uint64_t start = hostNanos();
+   while (hostNanos() - start < timeMicros * 1000ull) {
+      const int *frame = frames[rounds & 1];
+      for (int i = 0; i < numLeds; i++) {
+         byPixel.setPixel(i, frame[i % (fb.width * fb.height)]);
+      }
+      rounds++;
+   }
+   double before = (hostNanos() - start) / 1000.0 / rounds;
+
+   double dithered = timeShow(true);
+   double undithered = timeShow(false);
+   double refresh = timeRefresh();
+
+   printf("%-26s %8.2f us a frame\n", "before (setPixel per LED)", before);
+   printf("%-26s %8.2f us a frame (%.1fx)\n", "after, dithered", dithered, before / dithered);
+   printf("%-26s %8.2f us a frame (%.1fx)\n", "after, not dithered", undithered, before / undithered);
+   printf("%-26s %8.2f us\n", "dither refresh", refresh);
+
+   // decode check, from black so that every row is encoded again
+   fb.setDither(false);
+   fb.clearScreen();
+   fb.show();
+   drawFrame(frames[0]);
+   fb.show();
+   memset(setPixelMemory, 0, sizeof setPixelMemory);
+   for (int y = 0; y < fb.height; y++) {
+      for (int x = 0; x < fb.width; x++) {
+         byPixel.setPixel(layoutLedIndex(FB_LAYOUT, x, y), outputColor(frames[0][y * fb.width + x]));
+      }
+   }
+   bool same = !memcmp(drawingMemory, setPixelMemory, sizeof setPixelMemory);
+   printf("encoded frame %s setPixel's\n", same ? "matches" : "DIFFERS FROM");
+   hostInstantLeds = false;
+   return same ? 0 : 1;
+}
@@ -0,0 +1,133 @@
+/*
+ * The power limiter, before and after it kept running totals: the old one
+ * (kept here as it was: add up every channel of every LED, then, if that's
+ * over the limit, a fade pass over the screen before the encode; the fade
+ * is today's fixed-point one, so this is just the scan and the extra pass)
+ * against showWithLimit() now (the totals are already there; any scaling
+ * is done as the frame is encoded).
+ *
+ * Timed per frame, encode included, on frames bright enough to limit and
+ * on frames dim enough not to, best of a few tries; the drawing isn't
+ * timed. The old limit, a quarter of full brightness on the backpack,
+ * grows with the grid here so both limit the bright frames.
+ */
+
+#include <Arduino.h>
+#include <type_traits>
+#include "defs.h"
+#include "framebuffer.h"
+#include "platform.h"
+#include "host.h"
+
+typedef std::conditional<FB_DEEP_COLOR, uint64_t, uint32_t>::type Pixel;
+extern Pixel pixelMemory[];
+
+static const uint32_t timeMicros = 40000; // per try
+static const int tries = 5;               // per measurement, taking the best
+static const int numLeds = FB_PHYSICAL_HEIGHT * 8;
+static const int channelBits = FB_DEEP_COLOR ? 16 : 8;
+
+static int frames[2][FB_VIRTUAL_WIDTH * FB_VIRTUAL_HEIGHT];
+
+
+// the limiter as it was, in 8-bit units
+static void showWithLimitBefore() {
+   const Pixel mask = (1 << channelBits) - 1;
+   long value = 0;
+   for (int i = 0; i < numLeds; i++) {
+      Pixel pixel = pixelMemory[i];
+      value += (pixel >> 2 * channelBits & mask) + (pixel >> channelBits & mask) + (pixel & mask);
+   }
+   value >>= channelBits - 8;
+   long limit = 0x4000L * numLeds / 256;
+
+   if (value > limit) {
+      fb.fadeScreenByScale(1.0 * limit / value);
+   }
+   fb.show();
+}
+
+static void drawFrame(const int *frame) {
+   for (int y = 0; y < fb.height; y++) {
+      for (int x = 0; x < fb.width; x++) {
+         fb.setGridPixel(x, y, frame[y * fb.width + x]);
+      }
+   }
+}
+
+// the frame on the screen is dimmer than the one drawn
+static bool dimmed(const int *frame) {
+   for (int y = 0; y < fb.height; y++) {
+      for (int x = 0; x < fb.width; x++) {
+         if (fb.getGridPixel(x, y) != frame[y * fb.width + x]) {
+            return true;
+         }
+      }
+   }
+   return false;
+}
+
+static void makeFrames(int limit) {
+   randomSeed(1);
+   for (int f = 0; f < 2; f++) {
+      for (int i = 0; i < fb.width * fb.height; i++) {
+         frames[f][i] = fb.randomColor(limit);
+      }
+   }
+}
+
+// us per frame shown, alternating between the two frames; and whether the
+// limiter dimmed them
+static double timeLimiter(bool before, bool *limited) {
+   uint64_t spent = 0;
+   int rounds = 0;
+   while (spent < timeMicros * 1000ull) {
+      drawFrame(frames[rounds & 1]);
+      uint64_t start = hostNanos();
+      if (before) {
+         showWithLimitBefore();
+      } else {
+         fb.showWithLimit();
+      }
+      spent += hostNanos() - start;
+      rounds++;
+   }
+   *limited = dimmed(frames[(rounds - 1) & 1]);
+   return spent / 1000.0 / rounds;
+}
+
+
+int main() {
+   fb.begin();
+   hostInstantLeds = true;
+
+   printf("%dx%d grid, %d LEDs; us a frame\n", fb.width, fb.height, numLeds);
+   printf("%-8s %10s %10s\n", "", "limited", "not");
+   // [before, after][bright, dim], interleaved so they share the host's
+   // moods, best of the tries
+   const int limits[2] = { 0xFF, 0x10 };
+   double best[2][2];
+   bool limited[2][2];
+   for (int t = 0; t < tries; t++) {
+      for (int l = 0; l < 2; l++) {
+         makeFrames(limits[l]);
+         for (int after = 0; after < 2; after++) {
+            double perFrame = timeLimiter(!after, &limited[after][l]);
+            if (!t || perFrame < best[after][l]) {
+               best[after][l] = perFrame;
+            }
+         }
+      }
+   }
+   printf("%-8s %10.2f %10.2f\n", "before", best[0][0], best[0][1]);
+   printf("%-8s %10.2f %10.2f\n", "after", best[1][0], best[1][1]);
+   printf("%-8s %9.1fx %9.1fx\n", "", best[0][0] / best[1][0], best[0][1] / best[1][1]);
+   hostInstantLeds = false;
+
+   // the comparison only means something if both limit the same frames
+   bool fair = limited[0][0] && !limited[0][1] && limited[1][0] && !limited[1][1];
+   if (!fair) {
+      printf("the limiters didn't both limit just the bright frames\n");
+   }
+   return fair ? 0 : 1;
+}
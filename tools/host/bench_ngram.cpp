@@ -0,0 +1,119 @@
+/*
+ * GeoGrow's shapes, before and after the rasterizer: a frame of five
+ * n-grams the way they used to be drawn (double cos and sin per vertex,
+ * then Bresenham lines; kept here as it was) against the same five from
+ * rasterNGram (fixed point, a sine table, anti-aliased): the shapes alone,
+ * and the whole frame (cleared first, shown with the limiter). Then a frame
+ * of the routine itself, its echoes and all.
+ *
+ * The host has a hardware FPU, so the double math costs far less here
+ * than it did on the Teensy; and the new shapes are anti-aliased, so
+ * they touch more pixels than the old.
+ */
+
+#include <Arduino.h>
+#include "defs.h"
+#include "routine.h"
+#include "framebuffer.h"
+#include "raster.h"
+#include "host.h"
+
+static const uint32_t timeMicros = 200000; // per measurement
+static const int numShapes = 5;             // the current one and 4 echoes
+static byte stateBuf[ROUTINE_STATEBUF_SIZE];
+
+
+static void drawNGramBefore(float cx, float cy, unsigned numSides, float size, float rotate, int color) {
+   unsigned i;
+   int x[12], y[12];
+   if (numSides < 3) {
+      return;
+   }
+   if (numSides > ARRAYSIZE(x)) {
+      numSides = ARRAYSIZE(x);
+   }
+   for (i = 0; i < numSides; i++) {
+      x[i] = cx + size * cos(rotate + i * 2 * M_PI / numSides);
+      y[i] = cy + size * sin(rotate + i * 2 * M_PI / numSides);
+   }
+   for (i = 0; i < numSides; i++) {
+      int n = (i + 1) % numSides;
+      fb.drawGridLine(x[i], y[i], x[n], y[n], color);
+   }
+}
+
+// the shapes of one frame: growing from the middle, at GeoGrow's sizes
+static GeoGrow::Step shapes[numShapes];
+
+static void makeShapes(int frame) {
+   int end = toFixed(max(fb.width, fb.height)) / 2 * 3 / 2;
+   for (int i = 0; i < numShapes; i++) {
+      GeoGrow::Step *step = shapes + i;
+      step->color = fb.randomColor();
+      step->numSides = 3 + (frame + i) % 6;
+      step->rotation = (frame * 37 + i * 5000) & 0xFFFF;
+      step->cx = toFixed(fb.width - 1) / 2;
+      step->cy = toFixed(fb.height - 1) / 2;
+      step->size = (end / numShapes * (i + 1) + frame * 16) % end;
+   }
+}
+
+static void drawShapes(bool before) {
+   for (int i = 0; i < numShapes; i++) {
+      GeoGrow::Step *step = shapes + i;
+      if (before) {
+         drawNGramBefore(step->cx / (float)FIXED_ONE, step->cy / (float)FIXED_ONE, step->numSides,
+                         step->size / (float)FIXED_ONE, step->rotation * (2 * M_PI / 0x10000), step->color);
+      } else {
+         rasterNGram(step->cx, step->cy, step->numSides, step->size, step->rotation, step->color);
+      }
+   }
+}
+
+// us per frame: drawing the shapes, and the whole frame
+static void timeFrames(bool before, double *shapesMicros, double *frameMicros) {
+   uint64_t drawing = 0;
+   int frames = 0;
+   uint64_t start = hostNanos();
+   while (hostNanos() - start < timeMicros * 1000ull) {
+      makeShapes(frames);
+      fb.clearScreen();
+      uint64_t begin = hostNanos();
+      drawShapes(before);
+      drawing += hostNanos() - begin;
+      fb.showWithLimit();
+      frames++;
+   }
+   *shapesMicros = drawing / 1000.0 / frames;
+   *frameMicros = (hostNanos() - start) / 1000.0 / frames;
+}
+
+
+int main() {
+   randomSeed(1);
+   fb.begin();
+   hostInstantLeds = true;
+   printf("%dx%d grid\n", fb.width, fb.height);
+
+   double before[2], after[2];
+   timeFrames(true, before, before + 1);
+   timeFrames(false, after, after + 1);
+   printf("us a frame of %d shapes  %8s %8s\n", numShapes, "shapes", "frame");
+   printf("%-24s %8.2f %8.2f\n", "before", before[0], before[1]);
+   printf("%-24s %8.2f %8.2f\n", "after", after[0], after[1]);
+
+   GeoGrow geoGrow;
+   geoGrow.begin(stateBuf);
+   QualityInfo quality = { 0, 1, 256, true };
+   geoGrow.setQuality(&quality);
+   FrameTimingInfo frameTiming = { 500, 0, 0, 16667, 0 };
+   int frames = 0;
+   uint64_t start = hostNanos();
+   while (hostNanos() - start < timeMicros * 1000ull) {
+      geoGrow.drawOnFrameSync(&frameTiming);
+      frames++;
+   }
+   printf("GeoGrow: %.2f us a frame\n", (hostNanos() - start) / 1000.0 / frames);
+   hostInstantLeds = false;
+   return 0;
+}
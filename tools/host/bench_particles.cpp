@@ -0,0 +1,64 @@
+/*
+ * ParticleSystem (particles.h): ns per particle for the update, and for
+ * drawing them as points and as trails, with the system full and a
+ * quarter full (the update runs down all the slots, live or not).
+ */
+
+#include <Arduino.h>
+#include "defs.h"
+#include "framebuffer.h"
+#include "particles.h"
+#include "host.h"
+
+static const int capacity = 4096;
+static const uint32_t timeMicros = 200000; // per measurement
+static const int trailLength = 8;
+
+static ParticleSystem<capacity> particles;
+
+
+static void fill(int n) {
+   particles.begin();
+   for (int i = 0; i < n; i++) {
+      // slow enough, with margin enough, that none leave while being timed
+      particles.add(toFixed(random(fb.width)), toFixed(random(fb.height)),
+                    random(-8, 9), random(-8, 9), fb.randomPrimaryOrSecondary(0xFF));
+   }
+}
+
+typedef enum { UPDATE, RENDER, TRAILS } Kernel;
+
+// ns per live particle
+static double timeKernel(Kernel kernel, int n) {
+   fill(n);
+   int rounds = 0;
+   uint64_t start = hostNanos();
+   while (hostNanos() - start < timeMicros * 1000ull) {
+      switch (kernel) {
+         case UPDATE: particles.update(1 << 20); break;
+         case RENDER: particles.render(); break;
+         case TRAILS: particles.renderTrails(trailLength, 205); break;
+      }
+      rounds++;
+   }
+   uint64_t spent = hostNanos() - start;
+   if (particles.count != n) {
+      printf("lost particles: %d of %d left\n", particles.count, n);
+   }
+   return (double)spent / rounds / n;
+}
+
+
+int main() {
+   randomSeed(1);
+   fb.begin();
+
+   printf("%d slots, %dx%d grid; ns per live particle\n", capacity, fb.width, fb.height);
+   printf("%-8s %10s %10s\n", "", "full", "1/4 full");
+   const char *names[] = { "update", "render", "trails" };
+   for (int kernel = UPDATE; kernel <= TRAILS; kernel++) {
+      printf("%-8s %10.2f %10.2f\n", names[kernel], timeKernel((Kernel)kernel, capacity),
+             timeKernel((Kernel)kernel, capacity / 4));
+   }
+   return 0;
+}
@@ -0,0 +1,79 @@
+/*
+ * Presenting frames, before and after show() stopped waiting for the LEDs,
+ * at the strip length this was built for (see Makefile): a routine drawing
+ * back to back, each frame taking the given render time, for a second on
+ * the simulated clock, with the LEDs taking as long as real ones (the
+ * OctoWS2811 stub's busy()).
+ *
+ * before: show() waits for the last transfer to finish, as leds.show()
+ * used to; the time spent waiting is the CPU lost to it.
+ * after: show() hands the frame over if the LEDs are free, and otherwise
+ * leaves it for present(), called after each frame as the scene loop does;
+ * a frame still waiting when the next is shown is dropped.
+ *
+ * Either way the LEDs can't take frames faster than they're sent, so the
+ * fps is about the same; what the pipelining buys is the CPU time. (It
+ * falls a little short where a frame is left waiting for the present()
+ * after the next render; a scene with idle passes between frames calls it
+ * sooner.)
+ */
+
+#include <Arduino.h>
+#include "defs.h"
+#include "framebuffer.h"
+#include "host.h"
+
+static const uint32_t simulatedMicros = 1000000;
+static const uint32_t waitStep = 10; // how finely the wait polls
+
+
+typedef struct {
+   double fps;
+   double waitingPercent;
+   unsigned long dropped;
+} Result;
+
+static Result run(bool pipelined, uint32_t renderMicros) {
+   hostSimulateClock(1000000);
+   fb.resetStats();
+   uint32_t start = micros(), waiting = 0;
+   int frame = 0;
+   while (micros() - start < simulatedMicros) {
+      // a frame's drawing: enough to change a row, and the time it takes
+      fb.setGridPixel(0, 0, frame++ & 1 ? 0x102030 : 0x302010);
+      hostAdvanceClock(renderMicros);
+
+      if (!pipelined) {
+         while (fb.transmitting()) {
+            hostAdvanceClock(waitStep);
+            waiting += waitStep;
+         }
+      }
+      fb.show();
+      fb.present();
+   }
+   Result result;
+   uint32_t spent = micros() - start;
+   result.fps = fb.framesSent * 1e6 / spent;
+   result.waitingPercent = 100.0 * waiting / spent;
+   result.dropped = fb.framesDropped;
+   return result;
+}
+
+
+int main() {
+   fb.begin();
+
+   printf("%d LEDs a strip, %d us to send a frame (%.0f fps at most)\n", fb.ledsPerStrip,
+          fb.transmitMicros, 1e6 / fb.transmitMicros);
+   printf("%-10s %10s %10s %10s %10s\n", "render us", "before fps", "waiting", "after fps", "dropped/s");
+   const uint32_t renderMicros[] = { 50, 500, 2000, 10000 };
+   for (unsigned r = 0; r < ARRAYSIZE(renderMicros); r++) {
+      Result before = run(false, renderMicros[r]);
+      Result after = run(true, renderMicros[r]);
+      printf("%-10u %10.1f %9.0f%% %10.1f %10lu\n", renderMicros[r], before.fps, before.waitingPercent,
+             after.fps, after.dropped);
+   }
+   hostRealClock();
+   return 0;
+}
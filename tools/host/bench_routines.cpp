@@ -0,0 +1,152 @@
+/*
+ * What each routine costs to draw, and the frame rate it gets, at the grid
+ * size this was built for (see Makefile).
+ *
+ * draw: the routine's own callbacks for a frame, with LEDs that take no
+ * time, at full quality.
+ *
+ * scene: the real Scene running it, with LEDs that take as long to send
+ * to as real ones, so the frame rate is whatever the render time, the
+ * transmit time and the quality governor make of it; the spread of the
+ * times between frames says how steady that is. Across the sizes `make
+ * bench` builds this for, it says how well that holds up as the canvas
+ * grows.
+ */
+
+#include <Arduino.h>
+#include "defs.h"
+#include "routine.h"
+#include "scene.h"
+#include "framebuffer.h"
+#include "control_pad.h"
+#include "audio.h"
+#include "platform.h"
+#include "host.h"
+
+extern Scene scene;
+extern const char *routineNames[];
+
+static const uint32_t drawMicros = 200000;    // per routine, timing draws
+static const uint32_t warmupMicros = 200000;  // for the scene to settle on a pace
+static const uint32_t sceneMicros = 1000000;  // then timing its frames
+static const uint32_t maxSceneMicros = 5000000;
+static const int minFrames = 10;
+static const uint32_t framePeriod = 16667;    // for the draw timing: 60 fps
+static const uint32_t beatPeriod = 500000;
+
+
+static void frameTimingAt(FrameTimingInfo *frameTiming, uint32_t t) {
+   uint32_t sinceBeat = t % beatPeriod;
+   frameTiming->beatLength = beatPeriod / 1000;
+   frameTiming->beatRelative = sinceBeat / 1000;
+   frameTiming->beatPhase = ((uint64_t)sinceBeat << 16) / beatPeriod;
+   frameTiming->elapsed = t ? framePeriod : 0;
+   frameTiming->time = t / 1000;
+}
+
+
+// us per frame
+static double timeDraws(Routine *routine) {
+   hostInstantLeds = true;
+   FrameTimingInfo frameTiming;
+   uint64_t spent = 0;
+   int frames = 0;
+   uint32_t t = 0;
+   uint64_t start = hostNanos();
+   while (hostNanos() - start < drawMicros * 1000ull || frames < minFrames) {
+      frameTimingAt(&frameTiming, t);
+      uint64_t before = hostNanos();
+      if (t % beatPeriod < framePeriod) {
+         routine->drawOnBeatSync(&frameTiming);
+      }
+      routine->drawOnFrameSync(&frameTiming);
+      if (!routine->drawBetweenFrames(&frameTiming)) {
+         routine->workBetweenFrames(&frameTiming);
+      }
+      fb.present();
+      spent += hostNanos() - before;
+      frames++;
+      t += framePeriod;
+   }
+   hostInstantLeds = false;
+   return spent / 1000.0 / frames;
+}
+
+
+typedef struct {
+   double fps;
+   double meanInterval; // ms
+   double spread;       // standard deviation of the intervals, ms
+   double worst;        // ms
+} SceneStats;
+
+static void timeScene(SceneStats *stats) {
+   uint64_t start = hostNanos();
+   while (hostNanos() - start < warmupMicros * 1000ull) {
+      scene.loop();
+   }
+
+   unsigned long sent = fb.framesSent;
+   uint64_t last = 0, first = 0;
+   double sum = 0, sumSquares = 0, worst = 0;
+   int intervals = 0;
+   start = hostNanos();
+   while (true) {
+      uint64_t now = hostNanos();
+      if (now - start >= maxSceneMicros * 1000ull ||
+          (now - start >= sceneMicros * 1000ull && intervals >= minFrames)) {
+         break;
+      }
+      scene.loop();
+      if (fb.framesSent != sent) {
+         sent = fb.framesSent;
+         now = hostNanos();
+         if (last) {
+            double interval = (now - last) / 1e6;
+            sum += interval;
+            sumSquares += interval * interval;
+            worst = max(worst, interval);
+            intervals++;
+         } else {
+            first = now;
+         }
+         last = now;
+      }
+   }
+
+   stats->fps = intervals ? intervals / ((last - first) / 1e9) : 0;
+   stats->meanInterval = intervals ? sum / intervals : 0;
+   stats->spread = intervals ? sqrt(max(0.0, sumSquares / intervals - stats->meanInterval * stats->meanInterval)) : 0;
+   stats->worst = worst;
+}
+
+
+int main() {
+   randomSeed(1);
+   fb.begin();
+   controls.begin(CONTROL_MAJMODE_PREV_PIN, CONTROL_MAJMODE_NEXT_PIN,
+                  CONTROL_MINMODE_PREV_PIN, CONTROL_MINMODE_NEXT_PIN,
+                  CONTROL_SPEED_PIN, CONTROL_NEEDS_PULLUP);
+   audio.begin(NULL);
+   scene.begin();
+
+   printf("%dx%d grid, %d us to send a frame\n", fb.width, fb.height, fb.transmitMicros);
+   printf("%-20s %10s %10s | %8s %10s %10s %10s %8s\n", "routine", "draw us", "pixels/ms",
+          "fps", "mean ms", "spread ms", "worst ms", "quality");
+   do {
+      const char *name = routineNames[scene.whichRoutine];
+      double drawn = timeDraws(scene.curRoutine);
+
+      // and again from the top, for the scene
+      scene.onChooseNewRoutine(0);
+      SceneStats stats;
+      timeScene(&stats);
+
+      printf("%-20s %10.1f %10.0f | %8.1f %10.2f %10.2f %10.2f %8d\n", name, drawn,
+             fb.width * fb.height * 1000.0 / max(drawn, 0.001),
+             stats.fps, stats.meanInterval, stats.spread, stats.worst, scene.qualityLevel);
+
+      scene.onChooseNewRoutine(1);
+   } while (scene.whichRoutine != 0);
+   return 0;
+}
@@ -0,0 +1,85 @@
+/*
+ * The span primitives against the setGridPixel loops they replaced:
+ * pixels a microsecond for whole columns, whole rows and the whole screen
+ * as a rectangle, each filled both ways. The color alternates, so every
+ * pixel written changes.
+ *
+ * On this layout (see platform.h) columns run along the strips and rows
+ * across them, so fillColumnSpan gets the stride and fillRowSpan doesn't.
+ */
+
+#include <Arduino.h>
+#include "defs.h"
+#include "framebuffer.h"
+#include "host.h"
+
+static const uint32_t timeMicros = 200000; // per measurement
+
+typedef enum { COLUMNS, ROWS, RECT } Shape;
+
+
+static void fillSpans(Shape shape, int color) {
+   switch (shape) {
+      case COLUMNS:
+         for (int x = 0; x < fb.width; x++) {
+            fb.fillColumnSpan(x, 0, fb.height - 1, color);
+         }
+         break;
+      case ROWS:
+         for (int y = 0; y < fb.height; y++) {
+            fb.fillRowSpan(y, 0, fb.width - 1, color);
+         }
+         break;
+      case RECT:
+         fb.fillRect(0, 0, fb.width - 1, fb.height - 1, color);
+         break;
+   }
+}
+
+// the loops as they were
+static void fillPixels(Shape shape, int color) {
+   if (shape == ROWS) {
+      for (int y = 0; y < fb.height; y++) {
+         for (int x = 0; x < fb.width; x++) {
+            fb.setGridPixel(x, y, color);
+         }
+      }
+   } else {
+      for (int x = 0; x < fb.width; x++) {
+         for (int y = 0; y < fb.height; y++) {
+            fb.setGridPixel(x, y, color);
+         }
+      }
+   }
+}
+
+// pixels a microsecond
+static double timeFill(Shape shape, bool spans) {
+   int rounds = 0;
+   uint64_t start = hostNanos();
+   while (hostNanos() - start < timeMicros * 1000ull) {
+      int color = rounds & 1 ? 0x102030 : 0x302010;
+      if (spans) {
+         fillSpans(shape, color);
+      } else {
+         fillPixels(shape, color);
+      }
+      rounds++;
+   }
+   return (double)rounds * fb.numPixels * 1000 / (hostNanos() - start);
+}
+
+
+int main() {
+   fb.begin();
+
+   printf("%dx%d grid; pixels a us\n", fb.width, fb.height);
+   printf("%-10s %12s %8s\n", "", "setGridPixel", "spans");
+   const char *names[] = { "columns", "rows", "rect" };
+   for (int shape = COLUMNS; shape <= RECT; shape++) {
+      double before = timeFill((Shape)shape, false);
+      double after = timeFill((Shape)shape, true);
+      printf("%-10s %12.1f %8.1f (%.1fx)\n", names[shape], before, after, after / before);
+   }
+   return 0;
+}
@@ -0,0 +1,96 @@
+/*
+ * SpectrumRoutine's pipeline on a WAV file: what a block (the window,
+ * the FFT stages and the bands) costs, the worst single step (each has to
+ * fit in its workBetweenFrames budget), and whether the loudest band is
+ * the one with the tone in it.
+ *
+ * usage: bench_spectrum file.wav [tone Hz]
+ *
+ * The file is played in on the simulated clock, as the ADC would; the
+ * steps are timed on the real one.
+ */
+
+#include <Arduino.h>
+#include "defs.h"
+#include "routine.h"
+#include "framebuffer.h"
+#include "audio.h"
+#include "host.h"
+#include "wav_source.h"
+
+static const uint32_t loopMicros = 1000; // simulated time between passes
+static byte stateBuf[ROUTINE_STATEBUF_SIZE];
+
+
+int main(int argc, char **argv) {
+   if (argc < 2) {
+      fprintf(stderr, "usage: %s file.wav [tone Hz]\n", argv[0]);
+      return 2;
+   }
+   WavAudioSource wav;
+   if (!wav.open(argv[1])) {
+      return 1;
+   }
+   double tone = argc > 2 ? atof(argv[2]) : 0;
+
+   fb.begin();
+   hostSimulateClock(1000000);
+   audio.begin(&wav);
+   wav.play(true);
+   SpectrumRoutine spectrum;
+   spectrum.begin(stateBuf);
+   SpectrumRoutine::Data *data = spectrum.data;
+
+   uint64_t blockNanos = 0, worstStep = 0, stepNanos = 0;
+   int blocks = 0, steps = 0;
+   int64_t levels[SpectrumRoutine::maxBars] = { 0 };
+   uint32_t half = wav.duration() / 2;
+   while (!wav.finished()) {
+      audio.process();
+      while (true) {
+         bool last = data->stage == SpectrumRoutine::fftStages + 1;
+         uint64_t before = hostNanos();
+         if (!spectrum.step()) {
+            break;
+         }
+         uint64_t spent = hostNanos() - before;
+         stepNanos += spent;
+         worstStep = max(worstStep, spent);
+         steps++;
+         if (last) {
+            blockNanos += stepNanos;
+            stepNanos = 0;
+            blocks++;
+            if (micros() - wav.start >= half) {
+               for (int b = 0; b < data->numBars; b++) {
+                  levels[b] += data->level[b];
+               }
+            }
+         }
+      }
+      hostAdvanceClock(loopMicros);
+   }
+
+   int loudest = 0;
+   for (int b = 0; b < data->numBars; b++) {
+      if (levels[b] > levels[loudest]) {
+         loudest = b;
+      }
+   }
+   double binHz = (double)wav.sampleRate / SpectrumRoutine::fftSize;
+   double low = data->bandStart[loudest] * binHz - binHz / 2;
+   double high = data->bandStart[loudest + 1] * binHz - binHz / 2;
+
+   printf("%d blocks, %.1f per second of audio\n", blocks, blocks / (wav.duration() / 1e6));
+   printf("%.2f us per block, %.3f us per step, worst step %.2f us (budget %u)\n",
+          blocks ? blockNanos / 1000.0 / blocks : 0, steps ? (blockNanos + stepNanos) / 1000.0 / steps : 0,
+          worstStep / 1000.0, SpectrumRoutine::stepBudgetMicros);
+   printf("loudest band %d of %d: %.0f - %.0f Hz", loudest, data->numBars, low, high);
+   if (tone) {
+      bool found = tone >= low && tone < high;
+      printf(", %s the %.0f Hz tone\n", found ? "has" : "MISSES", tone);
+      return found ? 0 : 1;
+   }
+   printf("\n");
+   return 0;
+}
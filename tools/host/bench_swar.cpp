@@ -0,0 +1,227 @@
+/*
+ * The packed (SWAR) color kernels against the per-channel code they
+ * replaced, kept here as it was: first that they give the same answers,
+ * then what each costs a pixel.
+ *
+ * scale: scalePixelFixed, and scalePixel (which rounds the float to 8.8
+ * first) against r, g and b each multiplied by the float. Every channel
+ * value at every scale k/256 has to match exactly; other scales, which
+ * the float can land between, to within 1.
+ * add: addPixelComponents against min(a + b, 255) a channel, for every
+ * pair of channel values.
+ * fade: fadeScreenByStep against max(c - step, 0), for every channel value
+ * and step.
+ *
+ * Each channel value goes through every lane, next to different values in
+ * the others, so a carry or borrow across lanes would show. The host has a
+ * hardware FPU, so the gap on the Teensy, which doesn't, is wider than the
+ * timings show; and the screen fade works on the deep-color buffer (see
+ * platform.h), twice the size of the 0xRRGGBB ints the old one had.
+ */
+
+#include <Arduino.h>
+#include "defs.h"
+#include "framebuffer.h"
+#include "platform.h"
+#include "host.h"
+
+static const uint32_t timeMicros = 200000; // per measurement
+static const int numColors = 4096;
+
+static int colors[numColors];
+static volatile int sink;
+
+
+static int __attribute__((noinline)) scalePixelBefore(int pixel, float scale) {
+   int r = (pixel >> 16) & 0xFF;
+   int g = (pixel >> 8) & 0xFF;
+   int b = pixel & 0xFF;
+
+   r *= scale;
+   g *= scale;
+   b *= scale;
+
+   return r << 16 | g << 8 | b;
+}
+
+static int __attribute__((noinline)) addPixelComponentsBefore(int p1, int p2) {
+   int r1 = (p1 & 0xFF0000) >> 16;
+   int g1 = (p1 & 0x00FF00) >> 8;
+   int b1 = (p1 & 0x0000FF);
+   int r2 = (p2 & 0xFF0000) >> 16;
+   int g2 = (p2 & 0x00FF00) >> 8;
+   int b2 = (p2 & 0x0000FF);
+
+   r1 = min(r1 + r2, 255);
+   g1 = min(g1 + g2, 255);
+   b1 = min(b1 + b2, 255);
+   return r1 << 16 | g1 << 8 | b1;
+}
+
+// and, as it did, the brightness totals for the limiter
+static long __attribute__((noinline)) fadeByStepBefore(int *pixels, int n, int fade) {
+   long sumR = 0, sumG = 0, sumB = 0;
+   for (int i = 0; i < n; i++) {
+      int pixel = pixels[i];
+      int r = (pixel >> 16) & 0xFF;
+      int g = (pixel >> 8) & 0xFF;
+      int b = pixel & 0xFF;
+
+      r -= fade;
+      g -= fade;
+      b -= fade;
+      if (r < 0) r = 0;
+      if (g < 0) g = 0;
+      if (b < 0) b = 0;
+
+      pixels[i] = r << 16 | g << 8 | b;
+      sumR += r;
+      sumG += g;
+      sumB += b;
+   }
+   return sumR + sumG + sumB;
+}
+
+
+// channel value v in every lane in turn, with w and v ^ w beside it
+static int lanes(int v, int w, int rotation) {
+   int channels[3] = { v, w & 0xFF, (v ^ w) & 0xFF };
+   return channels[rotation % 3] << 16 | channels[(rotation + 1) % 3] << 8 | channels[(rotation + 2) % 3];
+}
+
+// largest difference between any two corresponding channels
+static int channelError(int a, int b) {
+   int worst = 0;
+   for (int shift = 0; shift < 24; shift += 8) {
+      worst = max(worst, abs(((a >> shift) & 0xFF) - ((b >> shift) & 0xFF)));
+   }
+   return worst;
+}
+
+static bool checkScale() {
+   int wrong = 0, worst = 0;
+   for (int k = 0; k <= 256; k++) {
+      for (int v = 0; v < 256; v++) {
+         for (int r = 0; r < 3; r++) {
+            int pixel = lanes(v, v * 7 + k, r);
+            int expected = scalePixelBefore(pixel, k / 256.0f);
+            wrong += fb.scalePixelFixed(pixel, k) != expected;
+            wrong += fb.scalePixel(pixel, k / 256.0f) != expected;
+         }
+      }
+   }
+   for (int i = 0; i < 1000000; i++) {
+      int pixel = fb.randomColor(0x100);
+      float scale = random(0x1000000) / (float)0xFFFFFF;
+      worst = max(worst, channelError(fb.scalePixel(pixel, scale), scalePixelBefore(pixel, scale)));
+   }
+   printf("scale: %d wrong at k/256, off by at most %d elsewhere\n", wrong, worst);
+   return !wrong && worst <= 1;
+}
+
+static bool checkAdd() {
+   int wrong = 0;
+   for (int a = 0; a < 256; a++) {
+      for (int b = 0; b < 256; b++) {
+         for (int r = 0; r < 3; r++) {
+            int p1 = lanes(a, b + r, r);
+            int p2 = lanes(b, a * 3 + r, r);
+            wrong += fb.addPixelComponents(p1, p2) != addPixelComponentsBefore(p1, p2);
+         }
+      }
+   }
+   printf("add: %d wrong\n", wrong);
+   return !wrong;
+}
+
+static bool checkFade() {
+   static int expected[FB_VIRTUAL_WIDTH * FB_VIRTUAL_HEIGHT];
+   int wrong = 0;
+   for (int step = 0; step < 256; step++) {
+      for (int first = 0; first < 256 * 3; first += fb.numPixels) {
+         for (int i = 0; i < fb.numPixels; i++) {
+            int v = (first + i) % 256;
+            expected[i] = lanes(v, v + step, (first + i) / 256);
+            fb.setGridPixel(i % fb.width, i / fb.width, expected[i]);
+         }
+         fb.fadeScreenByStep(step, -1);
+         fadeByStepBefore(expected, fb.numPixels, step);
+         for (int i = 0; i < fb.numPixels; i++) {
+            wrong += fb.getGridPixel(i % fb.width, i / fb.width) != expected[i];
+         }
+      }
+   }
+   printf("fade: %d wrong\n", wrong);
+   return !wrong;
+}
+
+
+typedef enum { SCALE_FLOAT, SCALE_FIXED, SCALE_BEFORE, ADD, ADD_BEFORE } Kernel;
+
+// ns per call
+static double timeKernel(Kernel kernel) {
+   int calls = 0, acc = 0;
+   uint64_t start = hostNanos();
+   while (hostNanos() - start < timeMicros * 1000ull) {
+      for (int i = 0; i < numColors; i++) {
+         int c = colors[i];
+         switch (kernel) {
+            case SCALE_FLOAT: acc ^= fb.scalePixel(c, 0.7f); break;
+            case SCALE_FIXED: acc ^= fb.scalePixelFixed(c, 179); break;
+            case SCALE_BEFORE: acc ^= scalePixelBefore(c, 0.7f); break;
+            case ADD: acc ^= fb.addPixelComponents(c, colors[numColors - 1 - i]); break;
+            case ADD_BEFORE: acc ^= addPixelComponentsBefore(c, colors[numColors - 1 - i]); break;
+         }
+      }
+      calls += numColors;
+   }
+   sink = acc;
+   return (double)(hostNanos() - start) / calls;
+}
+
+// ns per pixel faded, over the screen or (before) an array as big
+static double timeFade(bool before) {
+   static int pixels[FB_VIRTUAL_WIDTH * FB_VIRTUAL_HEIGHT];
+   uint64_t spent = 0;
+   int passes = 0;
+   while (spent < timeMicros * 1000ull) {
+      // every so often, something to fade again (not timed)
+      if (passes % 64 == 0) {
+         for (int i = 0; i < fb.numPixels; i++) {
+            pixels[i] = colors[i % numColors];
+            fb.setGridPixel(i % fb.width, i / fb.width, colors[i % numColors]);
+         }
+      }
+      uint64_t start = hostNanos();
+      if (before) {
+         sink = fadeByStepBefore(pixels, fb.numPixels, 3);
+      } else {
+         fb.fadeScreenByStep(3, -1);
+      }
+      spent += hostNanos() - start;
+      passes++;
+   }
+   return (double)spent / passes / fb.numPixels;
+}
+
+
+int main() {
+   randomSeed(1);
+   fb.begin();
+
+   bool same = checkScale();
+   same &= checkAdd();
+   same &= checkFade();
+
+   for (int i = 0; i < numColors; i++) {
+      colors[i] = fb.randomColor(0x100);
+   }
+   printf("ns per pixel   %8s %8s\n", "before", "after");
+   printf("scale (float)  %8.2f %8.2f\n", timeKernel(SCALE_BEFORE), timeKernel(SCALE_FLOAT));
+   printf("scale (fixed)  %8s %8.2f\n", "", timeKernel(SCALE_FIXED));
+   printf("add            %8.2f %8.2f\n", timeKernel(ADD_BEFORE), timeKernel(ADD));
+   printf("fade by step   %8.2f %8.2f\n", timeFade(true), timeFade(false));
+
+   printf("%s\n", same ? "ok" : "FAILED");
+   return same ? 0 : 1;
+}
@@ -0,0 +1,131 @@
+/*
+ * Swirl, before and after its angles went into a map: the old frame (soft
+ * float atan2 and color scaling per pixel, kept here as it was) against
+ * the routine's now, and what bringing the map up to date costs while the
+ * center wanders. The host has a hardware FPU, so the gap on the Teensy,
+ * which doesn't, is wider than this shows.
+ *
+ * Then the wandering itself: frames as fast as the LEDs take them, for
+ * 10 s, should move the center as far as the rate says, however short each
+ * frame is.
+ */
+
+#include <Arduino.h>
+#include "defs.h"
+#include "routine.h"
+#include "framebuffer.h"
+#include "raster.h"
+#include "host.h"
+
+static const uint32_t timeMicros = 200000; // per measurement
+static byte stateBuf[ROUTINE_STATEBUF_SIZE];
+
+
+// the frame as it was drawn before the map
+static void drawBefore(float cx, float cy, float angleOffset, int brightness, int res) {
+   static const int swirlColors[7] = {
+      0x600000, 0x502000, 0x404000, 0x006000, 0x004040, 0x000060, 0x400040,
+   };
+   int brightScale = 256 >> 2 * (4 - brightness - 1);
+
+   for (int x = 0; x < fb.width; x += res) {
+      for (int y = 0; y < fb.height; y += res) {
+         float dx = x - cx + res * 0.5;
+         float dy = y - cy + res * 0.5;
+         float angle = atan2(dy, dx);
+         angle += angleOffset + M_PI;
+         if (angle > 2 * M_PI) {
+            angle -= 2 * M_PI;
+         }
+         float scale = angle / (2 * M_PI);
+         int bin = scale * ARRAYSIZE(swirlColors);
+         int color = fb.scalePixelFixed(swirlColors[bin], brightScale);
+         if (res == 1) {
+            fb.setGridPixel(x, y, color);
+         } else {
+            fb.fillRect(x, y, x + res - 1, y + res - 1, color);
+         }
+      }
+   }
+   fb.showWithLimit();
+}
+
+
+static FrameTimingInfo frameTiming(uint32_t elapsed) {
+   FrameTimingInfo frameTiming;
+   frameTiming.beatLength = 500;
+   frameTiming.beatRelative = 0;
+   frameTiming.beatPhase = 0;
+   frameTiming.elapsed = elapsed;
+   frameTiming.time = 0;
+   return frameTiming;
+}
+
+
+int main() {
+   fb.begin();
+   hostInstantLeds = true;
+   SwirlRoutine swirl;
+   swirl.begin(stateBuf);
+   SwirlRoutine::Data *data = swirl.data;
+   QualityInfo quality = { 0, 1, 256, true };
+   swirl.setQuality(&quality);
+   printf("%dx%d grid\n", fb.width, fb.height);
+
+   // before: floats per pixel, every frame
+   int frames = 0;
+   uint64_t start = hostNanos();
+   while (hostNanos() - start < timeMicros * 1000ull) {
+      drawBefore(fb.width / 2.0 + frames % 3, fb.height / 2.0, frames * 0.01, data->brightness, 1);
+      frames++;
+   }
+   double before = (hostNanos() - start) / 1000.0 / frames;
+
+   // after, with the center still: the map is up to date, so just the frame
+   FrameTimingInfo still = frameTiming(16667);
+   swirl.drawOnFrameSync(&still);
+   frames = 0;
+   start = hostNanos();
+   while (hostNanos() - start < timeMicros * 1000ull) {
+      swirl.drawOnFrameSync(&still);
+      frames++;
+   }
+   double after = (hostNanos() - start) / 1000.0 / frames;
+
+   // and a whole map, as the wandering center needs every so often
+   int maps = 0;
+   start = hostNanos();
+   while (hostNanos() - start < timeMicros * 1000ull) {
+      data->cx += maps & 1 ? FIXED_ONE / 4 : -FIXED_ONE / 4;
+      swirl.startMap();
+      maps++;
+   }
+   double map = (hostNanos() - start) / 1000.0 / maps;
+   bool mapped = data->mapCols * data->mapRows <= SwirlRoutine::maxMapBlocks;
+
+   printf("before: %.1f us a frame\n", before);
+   printf("after:  %.1f us a frame (%.1fx), %.1f us a map%s\n", after, before / after, map,
+          mapped ? "" : " (too big; the angles are worked out per frame instead)");
+
+   // wandering at a pixel a step (30 a second), frames as fast as the LEDs
+   // go: the center should move 30 / 12 pixels a second
+   swirl.begin(stateBuf);
+   swirl.setQuality(&quality);
+   data->dcx = data->dcy = 1;
+   uint32_t elapsed = fb.transmitMicros;
+   int moved = 0;
+   uint32_t simulated = 0;
+   FrameTimingInfo fast = frameTiming(elapsed);
+   while (simulated < 10000000) {
+      int cx = data->cx;
+      swirl.drawOnFrameSync(&fast);
+      swirl.workBetweenFrames(&fast);
+      moved += abs(data->cx - cx);
+      simulated += elapsed;
+   }
+   double expected = (1000000 / ROUTINE_STEP_MICROS) / 12.0 * simulated / 1e6;
+   printf("wandering at %u us a frame: moved %.2f pixels in %.1f s, expected %.2f\n",
+          elapsed, moved / (double)FIXED_ONE, simulated / 1e6, expected);
+   hostInstantLeds = false;
+   return fabs(moved / (double)FIXED_ONE - expected) < expected / 10 ? 0 : 1;
+}
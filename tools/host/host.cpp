@@ -0,0 +1,145 @@
+/*
+ * The Teensyduino core, as far as the dreamcoat uses it, and the globals
+ * main.cpp would define, for the host build.
+ */
+
+#include <Arduino.h>
+#include <chrono>
+#include "defs.h"
+#include "routine.h"
+#include "scene.h"
+#include "framebuffer.h"
+#include "control_pad.h"
+#include "profile.h"
+#include "audio.h"
+#include "host.h"
+
+Framebuffer fb;
+ControlPad controls;
+Scene scene;
+Profiler profiler;
+AudioInput audio;
+
+HostSerial Serial;
+
+
+/*
+ * Clock
+ */
+
+static const std::chrono::steady_clock::time_point hostStart = std::chrono::steady_clock::now();
+static bool simulated = false;
+static uint32_t simulatedMicros;
+
+uint64_t hostNanos() {
+   return std::chrono::duration_cast<std::chrono::nanoseconds>(
+      std::chrono::steady_clock::now() - hostStart).count();
+}
+
+void hostSimulateClock(uint32_t micros) {
+   simulated = true;
+   simulatedMicros = micros;
+}
+
+void hostAdvanceClock(uint32_t micros) {
+   simulatedMicros += micros;
+}
+
+void hostRealClock() {
+   simulated = false;
+}
+
+unsigned long micros() {
+   return simulated ? simulatedMicros : (uint32_t)(hostNanos() / 1000);
+}
+
+unsigned long millis() {
+   return micros() / 1000;
+}
+
+void delayMicroseconds(unsigned int us) {
+   if (simulated) {
+      simulatedMicros += us;
+   } else {
+      uint32_t start = micros();
+      while (micros() - start < us) {}
+   }
+}
+
+
+/*
+ * Random numbers, from a fixed seed so runs compare
+ */
+
+long random(long howBig) {
+   return howBig > 0 ? rand() % howBig : 0;
+}
+
+long random(long howSmall, long howBig) {
+   return howSmall + random(howBig - howSmall);
+}
+
+void randomSeed(unsigned long seed) {
+   srand(seed);
+}
+
+
+/*
+ * Pins and interrupts
+ */
+
+static const int numPins = 64;
+static int pinLevels[numPins];
+static void (*pinHandlers[numPins])();
+uint32_t hostPinReads;
+
+void pinMode(int pin, int mode) {
+   // pulled up till something pulls them down
+   if (mode == INPUT_PULLUP) {
+      pinLevels[pin] = HIGH;
+   }
+}
+
+int digitalRead(int pin) {
+   hostPinReads++;
+   return pinLevels[pin];
+}
+
+void digitalWrite(int pin, int value) {
+   pinLevels[pin] = value;
+}
+
+void hostSetPin(int pin, int level) {
+   if (pinLevels[pin] == level) {
+      return;
+   }
+   pinLevels[pin] = level;
+   if (pinHandlers[pin]) {
+      pinHandlers[pin]();
+   }
+}
+
+int digitalPinToInterrupt(int pin) {
+   return pin;
+}
+
+void attachInterrupt(int interrupt, void (*handler)(), int mode) {
+   pinHandlers[interrupt] = handler;
+}
+
+int analogRead(int pin) {
+   return 512;
+}
+
+void analogReadResolution(int bits) {}
+void analogReadAveraging(int samples) {}
+
+bool IntervalTimer::begin(void (*handler)(), unsigned int micros) {
+   return true;
+}
+
+void IntervalTimer::end() {}
+
+
+bool hostInstantLeds = false;
+int hostFailures = 0;
@@ -0,0 +1,42 @@
+/*
+ * host.h
+ *
+ * Running the dreamcoat's code on a PC, for benchmarks and tests: the
+ * Teensy's clock, pins and LEDs are stubbed out (Arduino.h, OctoWS2811.h)
+ * and driven from here.
+ *
+ * The clock is the real one, for timing things, unless a test takes it
+ * over to step through time itself.
+ */
+
+#pragma once
+
+#include <stdint.h>
+
+// micros() and millis() from now on return simulated time, starting here
+void hostSimulateClock(uint32_t micros);
+void hostAdvanceClock(uint32_t micros);
+// back to real time
+void hostRealClock();
+
+// real time, for benchmarks, whatever micros() says
+uint64_t hostNanos();
+
+// Set an input pin's level; if it changed and an interrupt handler is
+// attached, it runs (as a pin-change interrupt would).
+void hostSetPin(int pin, int level);
+extern uint32_t hostPinReads; // digitalRead calls, ever
+
+// LEDs that take no time to send to, for timing just the drawing
+extern bool hostInstantLeds;
+
+
+// minimal checks for the tests: count failures, and say where
+extern int hostFailures;
+#define CHECK(cond) \
+   do { \
+      if (!(cond)) { \
+         printf("%s:%d: check failed: %s\n", __FILE__, __LINE__, #cond); \
+         hostFailures++; \
+      } \
+   } while (0)
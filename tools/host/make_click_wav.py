@@ -0,0 +1,66 @@
+#!/usr/bin/env python
+"""
+Write a click track: a WAV file with a beat at a known tempo and phase, for
+the host benchmarks to play into the beat detector (see wav_source.h).
+
+usage: make_click_wav.py [--bpm N] [--seconds N] [--offset MS] [--tone HZ]
+                         [--hiss LEVEL] [--rate HZ] out.wav
+
+Each beat is a short thump and a burst of noise, like a kick and a hat
+together; the first is --offset ms in. Under them is a quiet hiss, as there
+would be other instruments, or the detector takes it for silence (see
+AudioInput::minLevel). --tone adds a steady sine as well, at a third of the
+clicks' level, which the beat detector should ignore (and the spectrum
+should show).
+"""
+
+from __future__ import print_function
+
+import argparse
+import math
+import random
+import struct
+import wave
+
+
+def main():
+   parser = argparse.ArgumentParser(description='Write a click track.')
+   parser.add_argument('out')
+   parser.add_argument('--bpm', type=float, default=120)
+   parser.add_argument('--seconds', type=float, default=30)
+   parser.add_argument('--offset', type=float, default=137, help='ms to the first beat')
+   parser.add_argument('--tone', type=float, default=0, help='Hz; 0 for none')
+   parser.add_argument('--hiss', type=float, default=0.1, help='0 to 1')
+   parser.add_argument('--rate', type=int, default=44100)
+   args = parser.parse_args()
+
+   random.seed(1)
+   rate = args.rate
+   period = 60.0 / args.bpm
+   click_length = int(0.03 * rate)
+
+   frames = []
+   for i in range(int(args.seconds * rate)):
+      t = float(i) / rate
+      x = args.hiss * random.uniform(-1, 1)
+      since = t - args.offset / 1000.0
+      if since >= 0:
+         n = int((since % period) * rate)
+         if n < click_length:
+            decay = math.exp(-5.0 * n / click_length)
+            x += 0.4 * decay * math.sin(2 * math.pi * 80 * n / rate)
+            x += 0.3 * decay * random.uniform(-1, 1)
+      if args.tone:
+         x += 0.2 * math.sin(2 * math.pi * args.tone * t)
+      frames.append(struct.pack('<h', int(max(-1.0, min(1.0, x)) * 32767)))
+
+   out = wave.open(args.out, 'wb')
+   out.setnchannels(1)
+   out.setsampwidth(2)
+   out.setframerate(rate)
+   out.writeframes(b''.join(frames))
+   out.close()
+
+
+if __name__ == '__main__':
+   main()
@@ -0,0 +1,85 @@
+/*
+ * platform.h, for the host build: the backpack's settings on a grid of any
+ * size (HOST_WIDTH x HOST_HEIGHT, 16x16 unless the Makefile says), wired the
+ * way the backpack is, so canvases bigger than the real ones can be tried.
+ * The Makefile can also turn off deep color (HOST_DEEP_COLOR).
+ */
+
+#pragma once
+
+#include "layout.h"
+#include "power.h"
+
+#ifndef HOST_WIDTH
+#define HOST_WIDTH 16
+#endif
+#ifndef HOST_HEIGHT
+#define HOST_HEIGHT 16
+#endif
+#ifndef HOST_DEEP_COLOR
+#define HOST_DEEP_COLOR true
+#endif
+static_assert(HOST_WIDTH % FB_LAYOUT_NUM_STRIPS == 0, "HOST_WIDTH has to split evenly over the strips");
+
+static const int FB_PHYSICAL_WIDTH = 8;
+static const int FB_PHYSICAL_HEIGHT = HOST_HEIGHT * (HOST_WIDTH / FB_LAYOUT_NUM_STRIPS);
+
+static const int FB_VIRTUAL_WIDTH = HOST_WIDTH;
+static const int FB_VIRTUAL_HEIGHT = HOST_HEIGHT;
+static const bool FB_MIRROR_X = false;
+static const bool FB_MIRROR_Y = false;
+
+// each strip runs up one column and back down the next, as many as it takes
+static constexpr FbLayout FB_LAYOUT = {
+   FB_PHYSICAL_HEIGHT,                     // stripLength
+   HOST_HEIGHT,                            // segmentLength
+   HOST_WIDTH / FB_LAYOUT_NUM_STRIPS,      // segmentsPerStrip
+   0,                                      // leadIn
+   0,                                      // segmentGap
+   true,                                   // firstSegmentUp
+   true,                                   // serpentine
+   true,                                   // segmentsRightToLeft
+   FB_MIRROR_X,
+   FB_MIRROR_Y,
+   0,                                      // rotation
+};
+
+// the backpack's LEDs, with a supply to match the grid
+static const FbPowerModel FB_POWER = {
+   63,   // redMicroampsPerUnit
+   67,   // greenMicroampsPerUnit
+   63,   // blueMicroampsPerUnit
+   800,  // idleMicroampsPerLed
+   500 * HOST_WIDTH * HOST_HEIGHT / 256,  // stripBudgetMilliamps
+   1500 * HOST_WIDTH * HOST_HEIGHT / 256, // totalBudgetMilliamps
+};
+
+static const bool FB_DEEP_COLOR = HOST_DEEP_COLOR;
+static const float FB_GAMMA = 2.2;
+static const bool FB_DITHER = true;
+
+// buttons and the microphone come from host.h, not pins
+static const int CONTROL_MAJMODE_PREV_PIN = 0;
+static const int CONTROL_MAJMODE_NEXT_PIN = 0;
+static const int CONTROL_MINMODE_PREV_PIN = 0;
+static const int CONTROL_MINMODE_NEXT_PIN = 0;
+static const int CONTROL_SPEED_PIN = 0;
+static const bool CONTROL_NEEDS_PULLUP = true;
+static const int AUDIO_INPUT_PIN = 0;
+
+// The backpack's, less the images (whose glyphs aren't all in the tree).
+#define Platform_DeclareRoutines \
+   USE(DripRoutine)              \
+   USE(Sparkle)                  \
+   USE(SnakeRoutine)             \
+   USE(SwirlRoutine)             \
+   USE(TranslucentSquares)       \
+   USE(ThrobRoutine)             \
+   USE(GeoGrow)                  \
+   USE(ColorWash)                \
+   USE(PlasmaRoutine)            \
+   USE(Simon)                    \
+   USE(StripeRoutine)            \
+   USE(AutomatonRoutine)         \
+   USE(SpectrumRoutine)          \
+   /* end */
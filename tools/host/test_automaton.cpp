@@ -0,0 +1,114 @@
+/*
+ * CellularAutomaton (automaton.h) against the rules worked out a cell at a
+ * time, on widths either side of the 32-bit words and a height that's
+ * neither, for a few dozen generations from a random start; and the bits
+ * past the end of each row, which aren't cells, stay clear.
+ *
+ * Then AutomatonRoutine covers the whole canvas.
+ */
+
+#include <Arduino.h>
+#include "defs.h"
+#include "routine.h"
+#include "framebuffer.h"
+#include "automaton.h"
+#include "host.h"
+
+static const int height = 23;
+static const int maxWidth = 70;
+static const int generations = 30;
+static uint32_t storage[CellularAutomaton::storageWords(maxWidth, height)];
+static byte stateBuf[ROUTINE_STATEBUF_SIZE];
+
+
+// neighbours of x, y in the given state, wrapping around
+static int countAround(CellularAutomaton *ca, int x, int y, int state) {
+   int n = 0;
+   for (int dy = -1; dy <= 1; dy++) {
+      for (int dx = -1; dx <= 1; dx++) {
+         if ((dx || dy) &&
+             ca->state((x + dx + ca->width) % ca->width, (y + dy + ca->height) % ca->height) == state) {
+            n++;
+         }
+      }
+   }
+   return n;
+}
+
+// what x, y should be next generation
+static int expected(CellularAutomaton *ca, int x, int y) {
+   int s = ca->state(x, y);
+   switch (ca->rule) {
+      case CellularAutomaton::RULE_LIFE: {
+         int n = countAround(ca, x, y, 1);
+         return n == 3 || (s && n == 2);
+      }
+      case CellularAutomaton::RULE_BRAIN:
+         if (s) {
+            return s == 1 ? 2 : 0;
+         }
+         return countAround(ca, x, y, 1) == 2;
+      default: {
+         int ahead = (s + 1) % CellularAutomaton::cyclicStates;
+         return countAround(ca, x, y, ahead) >= CellularAutomaton::cyclicThreshold ? ahead : s;
+      }
+   }
+}
+
+
+int main() {
+   randomSeed(1);
+   fb.begin();
+
+   const int widths[] = { 8, 16, 31, 32, 33, 64, maxWidth };
+   for (int rule = 0; rule < CellularAutomaton::NUM_RULES; rule++) {
+      for (unsigned w = 0; w < ARRAYSIZE(widths); w++) {
+         CellularAutomaton ca;
+         int width = widths[w];
+         ca.begin(storage, width, height, (CellularAutomaton::Rule)rule);
+         ca.seed(rule == CellularAutomaton::RULE_CYCLIC ? 256 : 90);
+
+         int wrong = 0, stray = 0, changes = 0;
+         static int next[maxWidth * height];
+         for (int g = 0; g < generations; g++) {
+            for (int y = 0; y < height; y++) {
+               for (int x = 0; x < width; x++) {
+                  next[y * width + x] = expected(&ca, x, y);
+               }
+            }
+            int changed = ca.step();
+            changes += changed;
+
+            int differ = 0;
+            for (int y = 0; y < height; y++) {
+               for (int x = 0; x < width; x++) {
+                  wrong += ca.state(x, y) != next[y * width + x];
+                  differ += ca.state(x, y) != ca.state(x, y, true);
+               }
+            }
+            CHECK(changed == differ);
+            for (int p = 0; p < CellularAutomaton::planesPerGeneration; p++) {
+               for (int y = 0; y < height; y++) {
+                  stray += (ca.latest[(p * height + y) * ca.stride + ca.stride - 1] & ~ca.lastMask) != 0;
+               }
+            }
+         }
+         if (wrong || stray || !changes) {
+            printf("rule %d, width %d: %d cells wrong, %d rows with stray bits, %d changes\n",
+                   rule, width, wrong, stray, changes);
+         }
+         CHECK(!wrong);
+         CHECK(!stray);
+         CHECK(changes);
+      }
+   }
+
+   // the routine's grid is the canvas, however big
+   AutomatonRoutine automaton;
+   automaton.begin(stateBuf);
+   CHECK(automaton.data->ca.width == fb.width);
+   CHECK(automaton.data->ca.height == fb.height);
+
+   printf("%s\n", hostFailures ? "FAILED" : "ok");
+   return hostFailures ? 1 : 0;
+}
@@ -0,0 +1,227 @@
+/*
+ * Tap tempo (BeatTracker): taps replayed against the beat grid the way
+ * Scene::loop and Scene::onTap drive it, the grid advancing by nextBeat()
+ * and restarting on the tap when the tracker says so.
+ *
+ * - taps jittered around a steady beat: the period and the grid settle on
+ *   the music's, and stay within about a tap's jitter of it;
+ * - the music shifting its phase under a locked grid: the grid follows,
+ *   overshooting a little (the period takes up part of the shift, then
+ *   gives it back), and settles on it;
+ * - a sloppy tap now and then, off the beat, or a bounce: ignored; the grid
+ *   comes out exactly as it does from the same taps without them;
+ * - two off the grid running: a new tempo, taken from them.
+ */
+
+#include <Arduino.h>
+#include "defs.h"
+#include "gesture.h"
+#include "routine.h"
+#include "scene.h"
+#include "host.h"
+
+static const uint32_t initialPeriod = 500000;
+static const int maxGridBeats = 256;
+
+static BeatTracker tracker;
+static uint32_t lastBeat, nextBeat;
+static uint32_t gridBeats[maxGridBeats];
+static int numGridBeats;
+
+
+static void begin(uint32_t now) {
+   tracker.begin(initialPeriod);
+   lastBeat = now - initialPeriod;
+   nextBeat = now;
+   numGridBeats = 0;
+}
+
+// the scene's beats up to time
+static void runTo(uint32_t time) {
+   while (DEADLINE_REACHED(nextBeat, time)) {
+      lastBeat = nextBeat;
+      nextBeat = tracker.nextBeat(lastBeat);
+      if (numGridBeats < maxGridBeats) {
+         gridBeats[numGridBeats++] = lastBeat;
+      }
+   }
+}
+
+static BeatTracker::TapResult tap(uint32_t time) {
+   runTo(time);
+   BeatTracker::TapResult result = tracker.tap(time, lastBeat, nextBeat);
+   if (result == BeatTracker::TAP_FIRST || result == BeatTracker::TAP_SEEDED) {
+      nextBeat = time;
+   }
+   return result;
+}
+
+// us from time to the nearest beat of the music
+static int32_t phaseError(uint32_t time, uint32_t musicStart, uint32_t musicPeriod) {
+   int32_t sinceBeat = (time - musicStart) % musicPeriod;
+   return sinceBeat <= (int32_t)musicPeriod / 2 ? sinceBeat : sinceBeat - (int32_t)musicPeriod;
+}
+
+// worst phase error of the grid beats from time on
+static int32_t worstPhaseError(uint32_t from, uint32_t musicStart, uint32_t musicPeriod) {
+   int32_t worst = 0;
+   for (int b = 0; b < numGridBeats; b++) {
+      if (gridBeats[b] - from < 0x80000000) {
+         worst = max(worst, abs(phaseError(gridBeats[b], musicStart, musicPeriod)));
+      }
+   }
+   return worst;
+}
+
+// mean phase error of the grid beats from time on
+static int32_t meanPhaseError(uint32_t from, uint32_t musicStart, uint32_t musicPeriod) {
+   int64_t total = 0;
+   int n = 0;
+   for (int b = 0; b < numGridBeats; b++) {
+      if (gridBeats[b] - from < 0x80000000) {
+         total += abs(phaseError(gridBeats[b], musicStart, musicPeriod));
+         n++;
+      }
+   }
+   return n ? total / n : 0;
+}
+
+static int32_t jitter(int32_t range) {
+   return random(2 * range + 1) - range;
+}
+
+
+static void testJittered() {
+   // 125 bpm, each tap up to 20 ms early or late, starting off the grid
+   const uint32_t musicPeriod = 480000;
+   const int32_t tapJitter = 20000;
+   uint32_t musicStart = 1000000;
+   begin(musicStart - 300000);
+
+   const int numTaps = 64;
+   uint32_t settled = 0;
+   int32_t worstPeriodError = 0;
+   for (int i = 0; i < numTaps; i++) {
+      uint32_t t = musicStart + i * musicPeriod + jitter(tapJitter);
+      BeatTracker::TapResult result = tap(t);
+      CHECK(result == (i == 0 ? BeatTracker::TAP_FIRST : i == 1 ? BeatTracker::TAP_SEEDED
+                                                                : BeatTracker::TAP_LOCKED));
+      if (i == 16) {
+         settled = t;
+      }
+      if (settled) {
+         worstPeriodError = max(worstPeriodError, abs((int32_t)(tracker.period - musicPeriod)));
+      }
+   }
+   // and on after the taps stop
+   runTo(musicStart + (numTaps + 8) * musicPeriod);
+
+   CHECK(worstPeriodError < tapJitter / 2);
+   // the taps' own mean error is tapJitter / 2
+   CHECK(meanPhaseError(settled, musicStart, musicPeriod) < tapJitter / 2);
+   CHECK(worstPhaseError(settled, musicStart, musicPeriod) < tapJitter * 3 / 2);
+}
+
+static void testPhaseShift() {
+   // locked on 120 bpm, exact taps; then the music jumps 100 ms later
+   const uint32_t musicPeriod = 500000;
+   const int32_t shift = 100000;
+   uint32_t musicStart = 1000000;
+   begin(musicStart);
+   int i = 0;
+   for (; i < 8; i++) {
+      CHECK(tap(musicStart + i * musicPeriod) != BeatTracker::TAP_MISFIT);
+   }
+   CHECK(tracker.period == musicPeriod);
+   CHECK(phaseError(gridBeats[numGridBeats - 1], musicStart, musicPeriod) == 0);
+
+   // the grid's error on the beat before each tap
+   uint32_t shiftedStart = musicStart + shift;
+   const int numTaps = 24;
+   int32_t errors[numTaps];
+   for (int n = 0; n < numTaps; n++, i++) {
+      CHECK(tap(shiftedStart + i * musicPeriod) == BeatTracker::TAP_LOCKED);
+      errors[n] = abs(phaseError(gridBeats[numGridBeats - 1], shiftedStart, musicPeriod));
+   }
+   CHECK(errors[0] == shift);
+   // past it, by less than half as far; then closing in every beat
+   int32_t worst = 0;
+   for (int n = 4; n < numTaps; n++) {
+      worst = max(worst, errors[n]);
+   }
+   CHECK(worst < shift / 2);
+   CHECK(errors[10] < shift / 10);
+   for (int n = 5; n < numTaps; n++) {
+      CHECK(errors[n] < errors[n - 1]);
+   }
+   CHECK(errors[numTaps - 1] < 1000);
+   CHECK(abs((int32_t)(tracker.period - musicPeriod)) < 100);
+}
+
+// The same jittered taps, with or without a stray one every third beat:
+// in the middle of the beat, or a bounce just after a good tap. Returns
+// the misfits.
+static int playWithStrays(bool strays, uint32_t musicStart, uint32_t musicPeriod, int numTaps) {
+   const int32_t tapJitter = 10000;
+   randomSeed(2);
+   begin(musicStart);
+   int misfits = 0;
+   for (int i = 0; i < numTaps; i++) {
+      uint32_t t = musicStart + i * musicPeriod + jitter(tapJitter);
+      CHECK(tap(t) == (i == 0 ? BeatTracker::TAP_FIRST : i == 1 ? BeatTracker::TAP_SEEDED
+                                                                 : BeatTracker::TAP_LOCKED));
+      if (strays && i > 8 && i % 3 == 0 && i < numTaps - 1) {
+         uint32_t stray = t + (i % 2 ? musicPeriod / 2 + (i * 7919) % 100000 - 50000 : 30000);
+         runTo(stray);
+         uint32_t period = tracker.period;
+         int32_t correction = tracker.correction;
+         CHECK(tap(stray) == BeatTracker::TAP_MISFIT);
+         CHECK(tracker.period == period);
+         CHECK(tracker.correction == correction);
+         misfits++;
+      }
+   }
+   runTo(musicStart + numTaps * musicPeriod);
+   return misfits;
+}
+
+static void testOutliers() {
+   // 100 bpm, and the strays make no difference at all to the grid
+   const uint32_t musicPeriod = 600000;
+   const int numTaps = 48;
+   uint32_t musicStart = 1000000;
+   uint32_t withoutStrays[maxGridBeats];
+   CHECK(playWithStrays(false, musicStart, musicPeriod, numTaps) == 0);
+   int numBeats = numGridBeats;
+   uint32_t period = tracker.period;
+   memcpy(withoutStrays, gridBeats, sizeof gridBeats);
+   CHECK(playWithStrays(true, musicStart, musicPeriod, numTaps) == 13);
+   CHECK(numGridBeats == numBeats);
+   CHECK(!memcmp(gridBeats, withoutStrays, numBeats * sizeof gridBeats[0]));
+   CHECK(tracker.period == period);
+
+   // the music changes, to 86 bpm from half a beat later: two taps off
+   // the grid running reseed the tempo from them, and the beat restarts on
+   // the second
+   const uint32_t newPeriod = 700000;
+   uint32_t newStart = musicStart + numTaps * musicPeriod + musicPeriod / 2;
+   CHECK(tap(newStart) == BeatTracker::TAP_MISFIT);
+   CHECK(tap(newStart + newPeriod) == BeatTracker::TAP_SEEDED);
+   CHECK(tracker.period == newPeriod);
+   CHECK(nextBeat == newStart + newPeriod);
+   for (int n = 2; n < 8; n++) {
+      CHECK(tap(newStart + n * newPeriod) == BeatTracker::TAP_LOCKED);
+   }
+   CHECK(tracker.period == newPeriod);
+   CHECK(phaseError(gridBeats[numGridBeats - 1], newStart, newPeriod) == 0);
+}
+
+int main() {
+   randomSeed(1);
+   testJittered();
+   testPhaseShift();
+   testOutliers();
+
+   printf("%s\n", hostFailures ? "FAILED" : "ok");
+   return hostFailures ? 1 : 0;
+}
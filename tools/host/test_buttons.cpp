@@ -0,0 +1,152 @@
+/*
+ * Button debouncing (control_pad.h), with bouncy waveforms played into a
+ * pin on the simulated clock: each press and release is reported once,
+ * timed from its first edge, the reported state ends up where the pin
+ * did, and the loop only reads the pin after an edge was ignored.
+ */
+
+#include <Arduino.h>
+#include "defs.h"
+#include "routine.h"
+#include "scene.h"
+#include "control_pad.h"
+#include "host.h"
+
+static const uint32_t loopMicros = 300; // how often the loop gets round to the buttons
+static const int maxEvents = 16;
+
+typedef struct {
+   uint32_t at; // us into the waveform
+   int level;
+} Edge;
+
+typedef struct {
+   InputEvent event;
+   uint32_t seen; // when the loop got it
+} Seen;
+
+typedef struct {
+   Seen events[maxEvents];
+   int numEvents;
+   uint32_t loopReads; // pin reads from the loop, not the interrupts
+} Result;
+
+static uint32_t now = 1000000;
+
+
+// Play edges into button 0's pin, then let it sit, running the loop's
+// side every loopMicros throughout; the clock ends up `length` on.
+static void play(const Edge *edges, int numEdges, uint32_t length, Result *result) {
+   InputButton *button = controls.buttons;
+   uint32_t start = now;
+   uint32_t nextLoop = start;
+   int e = 0;
+   result->numEvents = 0;
+   result->loopReads = 0;
+
+   while (true) {
+      uint32_t nextEdge = e < numEdges ? start + edges[e].at : start + length;
+      if (nextLoop <= nextEdge && nextLoop - start < length) {
+         hostSimulateClock(nextLoop);
+         uint32_t reads = hostPinReads;
+         button->resync(0);
+         result->loopReads += hostPinReads - reads;
+
+         InputEvent event;
+         while (controls.events.pop(&event)) {
+            if (result->numEvents < maxEvents) {
+               result->events[result->numEvents].event = event;
+               result->events[result->numEvents].seen = nextLoop;
+            }
+            result->numEvents++;
+         }
+         nextLoop += loopMicros;
+      } else if (e < numEdges) {
+         hostSimulateClock(nextEdge);
+         hostSetPin(button->pin, edges[e++].level);
+      } else {
+         break;
+      }
+   }
+   now = start + length;
+   hostSimulateClock(now);
+}
+
+
+static void checkEvent(const Result *result, int i, bool pressed, uint32_t at, uint32_t start) {
+   if (i >= result->numEvents) {
+      CHECK(i < result->numEvents);
+      return;
+   }
+   const Seen *seen = result->events + i;
+   CHECK(seen->event.button == 0);
+   CHECK(seen->event.pressed == pressed);
+   CHECK(seen->event.time == start + at);
+   // within a loop pass, or a debounce time and one if it took a resync
+   CHECK(seen->seen - seen->event.time <= InputButton::debounceMicros + loopMicros);
+}
+
+
+int main() {
+   hostSimulateClock(now);
+   controls.begin(1, 2, 3, 4, 5, true);
+   InputButton *button = controls.buttons;
+   Result result;
+   uint32_t start;
+
+   // clean press and release: taken at once, and the loop never looks
+   const Edge clean[] = { { 0, LOW }, { 100000, HIGH } };
+   start = now;
+   play(clean, ARRAYSIZE(clean), 200000, &result);
+   CHECK(result.numEvents == 2);
+   checkEvent(&result, 0, true, 0, start);
+   checkEvent(&result, 1, false, 100000, start);
+   CHECK(result.events[0].seen - result.events[0].event.time <= loopMicros);
+   CHECK(result.loopReads == 0);
+
+   // contacts bouncing both ways: one event each, from the first edge, and
+   // a read to confirm once each burst settles
+   const Edge bouncy[] = {
+      { 0, LOW }, { 40, HIGH }, { 90, LOW }, { 400, HIGH }, { 1500, LOW },
+      { 150000, HIGH }, { 150030, LOW }, { 150200, HIGH },
+   };
+   start = now;
+   play(bouncy, ARRAYSIZE(bouncy), 300000, &result);
+   CHECK(result.numEvents == 2);
+   checkEvent(&result, 0, true, 0, start);
+   checkEvent(&result, 1, false, 150000, start);
+   CHECK(result.loopReads == 2);
+   CHECK(!button->wasPressed);
+
+   // a glitch shorter than the debounce time: taken as a press, and the
+   // release it ignored caught up with once things are quiet
+   const Edge glitch[] = { { 0, LOW }, { 300, HIGH } };
+   start = now;
+   play(glitch, ARRAYSIZE(glitch), 50000, &result);
+   CHECK(result.numEvents == 2);
+   checkEvent(&result, 0, true, 0, start);
+   checkEvent(&result, 1, false, 300, start);
+   CHECK(result.loopReads == 1);
+   CHECK(!button->wasPressed);
+
+   // a release that bounces back down and stays: still pressed at the end
+   const Edge stuck[] = { { 0, LOW }, { 100000, HIGH }, { 100050, LOW } };
+   start = now;
+   play(stuck, ARRAYSIZE(stuck), 200000, &result);
+   CHECK(result.numEvents == 3);
+   checkEvent(&result, 0, true, 0, start);
+   checkEvent(&result, 1, false, 100000, start);
+   checkEvent(&result, 2, true, 100050, start);
+   CHECK(button->wasPressed);
+   const Edge letGo[] = { { 0, HIGH } };
+   play(letGo, ARRAYSIZE(letGo), 50000, &result);
+   CHECK(result.numEvents == 1);
+
+   // nothing happening: the loop leaves the pin alone
+   play(NULL, 0, 1000000, &result);
+   CHECK(result.numEvents == 0);
+   CHECK(result.loopReads == 0);
+
+   printf("%s\n", hostFailures ? "FAILED" : "ok");
+   return hostFailures ? 1 : 0;
+}
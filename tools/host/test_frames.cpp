@@ -0,0 +1,246 @@
+/*
+ * Frame and beat scheduling (Scene::loop, Scene::advanceDeadline), with a
+ * routine that overruns on the simulated clock:
+ *
+ * - every frame over the frame budget: the frame period stretches to fit,
+ *   every beat gets the same whole number of frames, on a grid from the
+ *   beat, and nothing is dropped;
+ * - background work (workBetweenFrames) that stalls the loop, once for a
+ *   few frames and once for a few beats: the frames and beats it ran over
+ *   are dropped and counted, exactly, and everything after is still on the
+ *   grid it was on.
+ *
+ * And advanceDeadline itself, across the micros() wrap.
+ */
+
+#include <Arduino.h>
+#include "defs.h"
+#include "routine.h"
+#include "scene.h"
+#include "framebuffer.h"
+#include "control_pad.h"
+#include "profile.h"
+#include "audio.h"
+#include "platform.h"
+#include "host.h"
+
+extern Scene scene;
+
+static const uint32_t passMicros = 20;     // a pass of the loop with nothing to do
+static const uint32_t runMicros = 10000000;
+static const uint32_t beatPeriod = 500000; // the scene's, with no taps
+static const int maxFrames = 4096;
+static const int maxBeats = 64;
+static const int maxStalls = 2;
+
+
+class OverrunRoutine: public Routine {
+public:
+   void begin(void *stateBuf) {}
+
+   void drawOnBeatSync(FrameTimingInfo *frameTiming) {
+      if (numBeats < maxBeats) {
+         beatDrawn[numBeats] = micros();
+         beatTime[numBeats] = scene.lastBeatTime;
+         numBeats++;
+      }
+   }
+
+   void drawOnFrameSync(FrameTimingInfo *frameTiming) {
+      if (numFrames < maxFrames) {
+         frameStart[numFrames] = micros();
+         frameBeat[numFrames] = scene.lastBeatTime;
+      }
+      hostAdvanceClock(drawMicros);
+      fb.setGridPixel(0, 0, numFrames & 1 ? 0x102030 : 0x302010);
+      fb.show();
+      numFrames++;
+   }
+
+   bool workBetweenFrames(FrameTimingInfo *frameTiming) {
+      if (numStalls < maxStalls && stallMicros[numStalls] &&
+          DEADLINE_REACHED(stallAt[numStalls], micros())) {
+         stallStart[numStalls] = micros();
+         hostAdvanceClock(stallMicros[numStalls]);
+         stallEnd[numStalls] = micros();
+         numStalls++;
+         return true;
+      }
+      return false;
+   }
+
+   uint32_t drawMicros;
+   uint32_t stallAt[maxStalls], stallMicros[maxStalls];
+
+   int numFrames, numBeats, numStalls;
+   uint32_t frameStart[maxFrames], frameBeat[maxFrames];
+   uint32_t beatDrawn[maxBeats], beatTime[maxBeats];
+   uint32_t stallStart[maxStalls], stallEnd[maxStalls];
+};
+
+static OverrunRoutine routine;
+
+
+// Start the routine on a beat now, as onChooseNewRoutine would, and run
+// the scene for runMicros; returns the first beat.
+static uint32_t run() {
+   routine.numFrames = routine.numBeats = routine.numStalls = 0;
+   scene.curRoutine = &routine;
+   scene.framePeriod = scene.initialFramePeriod;
+   scene.renderMicros = 0;
+   scene.framesStarted = false;
+   profiler.begin(0, "OverrunRoutine");
+   scene.setQualityLevel(0);
+   fb.resetStats();
+
+   uint32_t start = micros();
+   scene.nextBeatTime = start;
+   scene.lastBeatTime = start - beatPeriod;
+   scene.nextFrameTime = start;
+   while (micros() - start < runMicros) {
+      scene.loop();
+      hostAdvanceClock(passMicros);
+   }
+   return start;
+}
+
+// every beat drawn on the grid from first, promptly; returns how many
+// beats went by undrawn
+static int checkBeats(uint32_t first, uint32_t worstLate) {
+   int skipped = 0;
+   for (int b = 0; b < routine.numBeats; b++) {
+      uint32_t t = routine.beatTime[b] - first;
+      CHECK(t % beatPeriod == 0);
+      CHECK(routine.beatDrawn[b] - routine.beatTime[b] <= worstLate);
+      if (b) {
+         skipped += (routine.beatTime[b] - routine.beatTime[b - 1]) / beatPeriod - 1;
+      }
+   }
+   return skipped;
+}
+
+// frames drawn after the beat at time
+static int framesInBeat(uint32_t beat) {
+   int n = 0;
+   for (int f = 0; f < routine.numFrames; f++) {
+      n += routine.frameBeat[f] == beat;
+   }
+   return n;
+}
+
+
+static void testAdvanceDeadline() {
+   // on time, late by a bit, late by periods; and the same across the wrap
+   const uint32_t starts[] = { 1000000, 0xFFFFFFFF - 25000 };
+   for (unsigned s = 0; s < ARRAYSIZE(starts); s++) {
+      uint32_t deadline = starts[s];
+      CHECK(scene.advanceDeadline(&deadline, 10000, starts[s]) == 0);
+      CHECK(deadline == starts[s] + 10000);
+      CHECK(scene.advanceDeadline(&deadline, 10000, starts[s] + 19999) == 0);
+      CHECK(deadline == starts[s] + 20000);
+      CHECK(scene.advanceDeadline(&deadline, 10000, starts[s] + 53000) == 3);
+      CHECK(deadline == starts[s] + 60000);
+      CHECK(DEADLINE_REACHED(starts[s] + 60000, deadline));
+      CHECK(!DEADLINE_REACHED(deadline, starts[s] + 59999));
+   }
+}
+
+// every frame over budget
+static void testSteadyOverrun() {
+   routine.drawMicros = 25000;
+   routine.stallMicros[0] = 0;
+   uint32_t first = run();
+
+   uint32_t period = routine.drawMicros + scene.idleMicros;
+   CHECK(scene.framePeriod == period);
+   CHECK(scene.qualityLevel == Scene::numQualityLevels - 1);
+
+   // the last frame before each beat runs into it a little, no more
+   CHECK(checkBeats(first, routine.drawMicros + passMicros) == 0);
+   CHECK(routine.numBeats == (int)(runMicros / beatPeriod));
+   CHECK(profiler.histogram(PROFILE_BEAT_LATE)->dropped == 0);
+
+   // after the first beat (which started at the initial frame period),
+   // frames at period steps from each beat, as many as fit
+   int perBeat = (beatPeriod - 1) / period;
+   for (int b = 1; b < routine.numBeats; b++) {
+      CHECK(framesInBeat(routine.beatTime[b]) == perBeat);
+   }
+   for (int f = 0; f < routine.numFrames; f++) {
+      if (routine.frameBeat[f] != first) {
+         uint32_t t = routine.frameStart[f] - routine.frameBeat[f];
+         CHECK(t % period < passMicros * 2);
+      }
+   }
+   CHECK(routine.numFrames >= perBeat * routine.numBeats - 2);
+   CHECK(routine.numFrames <= perBeat * routine.numBeats);
+
+   CHECK(profiler.histogram(PROFILE_FRAME_LATE)->dropped == 0);
+   CHECK(fb.framesDropped == 0);
+   CHECK(fb.framesSent == (unsigned long)routine.numFrames);
+}
+
+// background work running over a few frames, then over a few beats
+static void testStalls() {
+   routine.drawMicros = 5000;
+   routine.stallAt[0] = micros() + 2 * beatPeriod + beatPeriod / 5;
+   routine.stallMicros[0] = 60000;
+   routine.stallAt[1] = micros() + 8 * beatPeriod + beatPeriod / 3;
+   routine.stallMicros[1] = 1200000;
+   uint32_t first = run();
+   CHECK(routine.numStalls == 2);
+
+   // frames: the slots the first stall ran over are dropped, and the rest
+   // of that beat's frames stay on its grid
+   uint32_t period = scene.framePeriod;
+   CHECK(period == routine.drawMicros + scene.idleMicros);
+   uint32_t beat = first + (routine.stallStart[0] - first) / beatPeriod * beatPeriod;
+   uint32_t nextSlot = beat + ((routine.stallStart[0] - beat) / period + 1) * period;
+   uint32_t missedFrames = (routine.stallEnd[0] - nextSlot) / period;
+   CHECK(missedFrames >= 9);
+   CHECK(profiler.histogram(PROFILE_FRAME_LATE)->dropped == missedFrames);
+   int perBeat = (beatPeriod - 1) / period;
+   CHECK(framesInBeat(beat) + (int)missedFrames == perBeat);
+   // (the frame drawn late pushes the next ones back, and the idle time
+   // after each one draws them back onto the grid)
+   uint32_t catchUp = (period / (scene.idleMicros - passMicros) + 1) * period;
+   for (int f = 0; f < routine.numFrames; f++) {
+      uint32_t t = routine.frameStart[f] - routine.frameBeat[f];
+      bool afterStall = routine.frameStart[f] - routine.stallEnd[0] <= catchUp;
+      if (routine.frameBeat[f] != first && !afterStall) {
+         CHECK(t % period < passMicros * 2);
+      }
+   }
+
+   // beats: the second stall's are dropped, and the beat after it is the
+   // next one on the grid
+   uint32_t lastBeat = first + (routine.stallStart[1] - first) / beatPeriod * beatPeriod;
+   uint32_t missedBeats = (routine.stallEnd[1] - (lastBeat + beatPeriod)) / beatPeriod;
+   CHECK(missedBeats == 1);
+   CHECK(checkBeats(first, routine.stallMicros[1]) == (int)missedBeats);
+   CHECK(profiler.histogram(PROFILE_BEAT_LATE)->dropped == missedBeats);
+   CHECK(routine.numBeats + (int)missedBeats == (int)(runMicros / beatPeriod));
+   CHECK(fb.framesDropped == 0);
+}
+
+
+int main() {
+   randomSeed(1);
+   hostSimulateClock(1000000);
+   fb.begin();
+   controls.begin(CONTROL_MAJMODE_PREV_PIN, CONTROL_MAJMODE_NEXT_PIN,
+                  CONTROL_MINMODE_PREV_PIN, CONTROL_MINMODE_NEXT_PIN,
+                  CONTROL_SPEED_PIN, CONTROL_NEEDS_PULLUP);
+   audio.begin(NULL);
+   scene.begin();
+   // keep the histograms till we've looked at them
+   profiler.reportInterval = 0xFFFFFFFF;
+
+   testAdvanceDeadline();
+   testSteadyOverrun();
+   testStalls();
+
+   hostRealClock();
+   printf("%s\n", hostFailures ? "FAILED" : "ok");
+   return hostFailures ? 1 : 0;
+}
@@ -0,0 +1,55 @@
+/*
+ * Dither refreshes (Framebuffer::refresh): a frame whose channels all land
+ * on whole output levels (0 and full scale, through any gamma curve) isn't
+ * resent, one with something in between is, and one that's only partly
+ * redrawn still counts the rows that weren't. With the dither off, nothing
+ * is resent.
+ */
+
+#include <Arduino.h>
+#include "defs.h"
+#include "framebuffer.h"
+#include "host.h"
+
+
+int main() {
+   fb.begin();
+   hostInstantLeds = true;
+   fb.setDither(true);
+
+   // whole levels: nothing to dither
+   fb.fillScreen(0xFF00FF);
+   fb.show();
+   CHECK(!fb.refresh());
+   fb.clearScreen();
+   fb.show();
+   CHECK(!fb.refresh());
+
+   // a level in between, in one pixel
+   fb.setGridPixel(3, 5, 0x000080);
+   fb.show();
+   CHECK(fb.refresh());
+   CHECK(fb.refresh());
+
+   // other rows redrawn, that one left alone: still something to dither
+   fb.setGridPixel(fb.width - 1, 0, 0xFFFFFF);
+   fb.show();
+   CHECK(fb.refresh());
+
+   // and gone again
+   fb.setGridPixel(3, 5, 0);
+   fb.show();
+   CHECK(!fb.refresh());
+
+   // dither off
+   fb.setGridPixel(3, 5, 0x000080);
+   fb.show();
+   fb.setDither(false);
+   CHECK(!fb.refresh());
+   fb.setDither(true);
+   CHECK(fb.refresh());
+
+   hostInstantLeds = false;
+   printf("%s\n", hostFailures ? "FAILED" : "ok");
+   return hostFailures ? 1 : 0;
+}
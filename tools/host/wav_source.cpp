@@ -0,0 +1,126 @@
+#include <Arduino.h>
+#include "wav_source.h"
+
+static uint32_t le32(const uint8_t *p) {
+   return p[0] | p[1] << 8 | p[2] << 16 | (uint32_t)p[3] << 24;
+}
+
+static uint16_t le16(const uint8_t *p) {
+   return p[0] | p[1] << 8;
+}
+
+
+bool WavAudioSource::open(const char *path) {
+   FILE *file = fopen(path, "rb");
+   if (!file) {
+      fprintf(stderr, "%s: can't open\n", path);
+      return false;
+   }
+   std::vector<uint8_t> bytes;
+   uint8_t buf[4096];
+   size_t n;
+   while ((n = fread(buf, 1, sizeof buf, file)) > 0) {
+      bytes.insert(bytes.end(), buf, buf + n);
+   }
+   fclose(file);
+
+   if (bytes.size() < 12 || memcmp(&bytes[0], "RIFF", 4) || memcmp(&bytes[8], "WAVE", 4)) {
+      fprintf(stderr, "%s: not a WAV file\n", path);
+      return false;
+   }
+
+   // the chunks we want, whatever else is in there
+   int channels = 0, bits = 0;
+   uint32_t fileRate = 0;
+   const uint8_t *data = NULL;
+   uint32_t dataBytes = 0;
+   for (size_t at = 12; at + 8 <= bytes.size(); ) {
+      const uint8_t *chunk = &bytes[at];
+      uint32_t length = min((size_t)le32(chunk + 4), bytes.size() - at - 8);
+      if (!memcmp(chunk, "fmt ", 4) && length >= 16) {
+         if (le16(chunk + 8) != 1) {
+            fprintf(stderr, "%s: not PCM\n", path);
+            return false;
+         }
+         channels = le16(chunk + 10);
+         fileRate = le32(chunk + 12);
+         bits = le16(chunk + 22);
+      } else if (!memcmp(chunk, "data", 4)) {
+         data = chunk + 8;
+         dataBytes = length;
+      }
+      at += 8 + length + (length & 1);
+   }
+   if (!channels || !fileRate || !data || (bits != 8 && bits != 16)) {
+      fprintf(stderr, "%s: need 8 or 16 bit PCM\n", path);
+      return false;
+   }
+
+   // mono, -1 to 1
+   int frameBytes = channels * bits / 8;
+   size_t frames = dataBytes / frameBytes;
+   std::vector<float> mono(frames);
+   for (size_t i = 0; i < frames; i++) {
+      float sum = 0;
+      for (int c = 0; c < channels; c++) {
+         const uint8_t *p = data + i * frameBytes + c * bits / 8;
+         sum += bits == 8 ? (p[0] - 128) / 128.0f : (int16_t)le16(p) / 32768.0f;
+      }
+      mono[i] = sum / channels;
+   }
+
+   // at the ADC's rate, linearly interpolated, and its range: 10 bits, the
+   // middle at half the supply
+   sampleRate = AdcAudioSource::rate;
+   size_t count = frames ? (uint64_t)(frames - 1) * sampleRate / fileRate + 1 : 0;
+   samples.resize(count);
+   for (size_t i = 0; i < count; i++) {
+      double at = (double)i * fileRate / sampleRate;
+      size_t j = (size_t)at;
+      float frac = at - j;
+      float x = j + 1 < frames ? mono[j] * (1 - frac) + mono[j + 1] * frac : mono[j];
+      samples[i] = constrain((int)lrintf(512 + x * 511), 0, 1023);
+   }
+
+   play(true);
+   return true;
+}
+
+
+void WavAudioSource::play(bool paced) {
+   this->paced = paced;
+   next = 0;
+   start = micros();
+}
+
+
+int WavAudioSource::read(uint16_t *out, int count) {
+   size_t available = samples.size();
+   if (paced) {
+      available = min(available, (size_t)((uint64_t)(micros() - start) * sampleRate / 1000000));
+   }
+   int n = min((size_t)count, available - min(available, next));
+   memcpy(out, samples.data() + next, n * sizeof *out);
+   next += n;
+   return n;
+}
+
+
+uint32_t WavAudioSource::latency() {
+   if (!paced || !next) {
+      return 0;
+   }
+   // the last one read was due then
+   uint32_t taken = (uint64_t)(next - 1) * 1000000 / sampleRate;
+   return micros() - start - taken;
+}
+
+
+bool WavAudioSource::finished() {
+   return next >= samples.size();
+}
+
+
+uint32_t WavAudioSource::duration() {
+   return (uint64_t)samples.size() * 1000000 / sampleRate;
+}
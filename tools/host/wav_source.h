@@ -0,0 +1,37 @@
+/*
+ * wav_source.h
+ *
+ * An AudioSource (see audio.h) that plays a WAV file, for trying the beat
+ * detector and the spectrum out on recordings on the host. The file is
+ * read whole, mixed to mono and resampled to the ADC's rate and range, so
+ * the detector sees what it would from the microphone.
+ *
+ * Paced, samples come in as micros() passes, from when play() was called,
+ * as the ADC's would; unpaced, as fast as they're read, for timing the
+ * processing of them.
+ */
+
+#pragma once
+
+#include <stdint.h>
+#include <vector>
+#include "audio.h"
+
+class WavAudioSource : public AudioSource {
+public:
+   // PCM, 8 or 16 bits, any rate and number of channels; false (and why,
+   // on stderr) if it isn't
+   bool open(const char *path);
+   void play(bool paced);
+
+   virtual int read(uint16_t *samples, int count);
+   virtual uint32_t latency();
+
+   bool finished();
+   uint32_t duration(); // us
+
+   std::vector<uint16_t> samples; // at sampleRate, unsigned 10 bits
+   size_t next;                   // to read
+   bool paced;
+   uint32_t start;                // micros() at the first sample
+};
@@ -0,0 +1,222 @@
+"""
+Decode the dreamcoat's serial output: binary telemetry records (see
+src/telemetry.h) mixed with plain text, including DebugPrint messages (see
+src/debuglog.h), which are formatted here.
+
+usage: telemetry.py [file]
+
+Reads the raw byte stream from file (e.g. the Teensy's serial device, after
+"stty -F /dev/ttyACM0 raw") or stdin. Text is passed through; latency
+histograms are added up per routine and callback, and a summary is printed
+each time the framebuffer stats come round (every couple of seconds), with
+the frame rate each routine is achieving.
+"""
+
+from __future__ import print_function
+
+import os
+import re
+import struct
+import sys
+
+
+SYNC = 0xA5
+
+ROUTINE = 1
+HISTOGRAM = 2
+FB_STATS = 3
+LOG_FORMAT = 4
+LOG = 5
+
+CALLBACKS = ['beat', 'frame', 'tween', 'show', 'frame late', 'beat late', 'input late',
+             'audio', 'work']
+NUM_BUCKETS = 64
+
+
+def bucket_floor(bucket):
+   """Smallest duration (us) counted in bucket; see LatencyHistogram."""
+   if bucket < 4:
+      return bucket
+   log2 = bucket // 4 + 1
+   return (4 + bucket % 4) << (log2 - 2)
+
+
+class Histogram(object):
+   def __init__(self):
+      self.count = 0
+      self.min = None
+      self.max = 0
+      self.misses = 0
+      self.dropped = 0
+      self.buckets = [0] * NUM_BUCKETS
+
+   def add(self, count, lo, hi, misses, dropped, buckets):
+      if count:
+         self.min = lo if self.min is None else min(self.min, lo)
+         self.max = max(self.max, hi)
+      self.count += count
+      self.misses += misses
+      self.dropped += dropped
+      self.buckets = [a + b for (a, b) in zip(self.buckets, buckets)]
+
+   def percentile(self, p):
+      """Upper edge of the bucket holding the p'th percentile sample."""
+      target = self.count * p / 100.0
+      seen = 0
+      for (i, n) in enumerate(self.buckets):
+         seen += n
+         if seen >= target:
+            if i + 1 < NUM_BUCKETS:
+               return min(bucket_floor(i + 1) - 1, self.max)
+            return self.max
+      return self.max
+
+
+# printf conversions; length modifiers are dropped, since the args all
+# arrive as 32 bits and Python doesn't want them
+CONVERSION = re.compile(r'%([-+ #0]*[0-9]*(?:\.[0-9]+)?)(?:hh|h|ll|l|z|j|t)?([diouxXcsfFeEgG%])')
+
+
+def format_message(fmt, args):
+   """Unpack args as fmt's conversions expect (see debuglog.h) and format."""
+   values = []
+   pos = [0]
+
+   def take(n):
+      if pos[0] + n > len(args):
+         raise ValueError('truncated')
+      chunk = args[pos[0]:pos[0] + n]
+      pos[0] += n
+      return chunk
+
+   def convert(match):
+      (flags, kind) = match.groups()
+      if kind == '%':
+         return '%%'
+      if kind == 's':
+         n = bytearray(take(1))[0]
+         values.append(take(n).decode('ascii', 'replace'))
+      elif kind in 'fFeEgG':
+         values.append(struct.unpack('<f', take(4))[0])
+      elif kind in 'di':
+         values.append(struct.unpack('<i', take(4))[0])
+      else:
+         values.append(struct.unpack('<I', take(4))[0])
+      return '%' + flags + kind
+
+   try:
+      return CONVERSION.sub(convert, fmt) % tuple(values)
+   except ValueError:
+      return fmt.rstrip('\n') + ' <truncated args>\n'
+
+
+class Decoder(object):
+   def __init__(self, out):
+      self.out = out
+      self.names = {}
+      self.formats = {}  # address -> DebugPrint format
+      self.histograms = {}  # (routine, callback) -> Histogram
+      self.stats_time = None  # ms, of the last framebuffer stats
+      self.bad = 0
+
+   def routine_name(self, index):
+      return self.names.get(index, 'routine %d' % index)
+
+   def record(self, kind, payload):
+      if kind == ROUTINE:
+         index = bytearray(payload)[0]
+         name = payload[1:].split(b'\0')[0].decode('ascii', 'replace')
+         self.names[index] = name
+         self.out.write('# profiling %s\n' % name)
+      elif kind == HISTOGRAM:
+         fields = struct.unpack('<BBHIIII%dH' % NUM_BUCKETS, payload)
+         (routine, callback, misses, count, lo, hi, dropped) = fields[:7]
+         key = (routine, callback)
+         self.histograms.setdefault(key, Histogram()).add(count, lo, hi, misses, dropped, fields[7:])
+      elif kind == LOG_FORMAT:
+         (address,) = struct.unpack('<I', payload[:4])
+         self.formats[address] = payload[4:].decode('ascii', 'replace')
+      elif kind == LOG:
+         (time, address) = struct.unpack('<II', payload[:8])
+         fmt = self.formats.get(address)
+         if fmt is None:
+            message = '<unknown format %#x>\n' % address
+         else:
+            message = format_message(fmt, payload[8:])
+         self.out.write('[%10.6f] %s' % (time / 1e6, message))
+      elif kind == FB_STATS:
+         (time, milliamps, sent, skipped, dropped, rows, refreshes, refresh_us, period, quality) = \
+            struct.unpack('<IiIIIIIIIi', payload)
+         self.out.write('# t=%.1fs ~%d mA; %d sent, %d skipped, %d dropped, %d rows encoded'
+                        % (time / 1000.0, milliamps, sent, skipped, dropped, rows))
+         # the counters start over with each record, so this is the fps
+         # achieved since the last one
+         if self.stats_time is not None and time > self.stats_time:
+            self.out.write('; %.1f fps (aiming for %.1f at quality level %d)'
+                           % (sent * 1000.0 / (time - self.stats_time), 1e6 / period, quality))
+         self.stats_time = time
+         if refreshes:
+            self.out.write('; %d refreshes avg %d us' % (refreshes, refresh_us // refreshes))
+         self.out.write('\n')
+         self.summary()
+
+   def summary(self):
+      for key in sorted(self.histograms):
+         h = self.histograms[key]
+         self.out.write('#   %-20s %-10s n=%-7d min %6d  p50 %6d  p99 %6d  max %6d us  misses %d'
+                        % (self.routine_name(key[0]), CALLBACKS[key[1]], h.count, h.min or 0,
+                           h.percentile(50), h.percentile(99), h.max, h.misses))
+         if h.dropped:
+            self.out.write('  dropped %d' % h.dropped)
+         self.out.write('\n')
+      if self.bad:
+         self.out.write('#   (%d bad records)\n' % self.bad)
+
+   def decode(self, fd):
+      text = bytearray()
+      data = bytearray()
+      while True:
+         chunk = os.read(fd, 4096)  # whatever's there, so a tty doesn't stall
+         if not chunk:
+            break
+         data.extend(chunk)
+
+         i = 0
+         while i < len(data):
+            if data[i] != SYNC:
+               text.append(data[i])
+               i += 1
+               continue
+            if i + 3 > len(data):
+               break
+            length = data[i + 2]
+            if i + 4 + length > len(data):
+               break
+            payload = bytes(data[i + 3:i + 3 + length])
+            checksum = 0
+            for b in bytearray(payload):
+               checksum ^= b
+            if checksum != data[i + 3 + length]:
+               # not a record after all (or a damaged one): skip the sync byte
+               self.bad += 1
+               i += 1
+               continue
+            self.flush_text(text)
+            self.record(data[i + 1], payload)
+            i += 4 + length
+         del data[:i]
+         self.flush_text(text)
+
+   def flush_text(self, text):
+      if text:
+         self.out.write(text.decode('ascii', 'replace'))
+         del text[:]
+      self.out.flush()
+
+
+if __name__ == '__main__':
+   if len(sys.argv) > 1:
+      fd = os.open(sys.argv[1], os.O_RDONLY)
+   else:
+      fd = sys.stdin.fileno()
+   Decoder(sys.stdout).decode(fd)